@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "logger.hpp"
+#include "logger_binary_handler.hpp"
+#include "logger_default_handlers.hpp"
+#include "logger_layout.hpp"
+#include "logger_uring_handler.hpp"
+
+//! Микробенчмарки горячих путей логгера
+/*!
+  Запуск: make bench. Результаты записываются в bench.json (--benchmark_out).
+  Каталог файлов на tmpfs задается переменной окружения SLX_BENCH_TMPFS, по умолчанию /dev/shm.
+*/
+
+using namespace slx;
+
+namespace
+{
+  //! Обработчик, который ничего не делает. Измеряется только стоимость логгера
+  class HandlerNull : public HandlerInterface
+  {
+  protected:
+    int HandlerFunction(const LoggerEvent &) override
+    {
+      return 0;
+    }
+  };
+
+  //! Количество событий в одной итерации бенчмарков пропускной способности
+  const int THROUGHPUT_BATCH = 4096;
+
+  //! Количество вызовов на поток в бенчмарке задержек
+  const int LATENCY_CALLS = 20000;
+
+  std::string TmpfsDir()
+  {
+    const char * dir = getenv("SLX_BENCH_TMPFS");
+    if (dir != nullptr)
+    {
+      return dir;
+    }
+    return access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+  }
+
+  //! Логгер, общий для потоков одного бенчмарка
+  /*!
+    Создается потоком 0 до начала цикла и удаляется им после цикла.
+    Библиотека benchmark синхронизирует потоки на границах цикла.
+  */
+  std::unique_ptr<Logger> g_logger;
+
+  void SetupSharedLogger(const benchmark::State &i_state, Logger::Mode i_mode)
+  {
+    if (i_state.thread_index() == 0)
+    {
+      std::shared_ptr<HandlerNull> handler = std::make_shared<HandlerNull>();
+      handler->SetLogLevel(LoggerEvent::Level::INFO);
+      g_logger.reset(new Logger(i_mode));
+      g_logger->AddHandler(handler);
+    }
+  }
+
+  void TeardownSharedLogger(benchmark::State &io_state)
+  {
+    if (io_state.thread_index() == 0)
+    {
+      Logger::DropCounters drops = g_logger->GetDropCounters();
+      io_state.counters["dropped"] = static_cast<double>(drops.newest + drops.oldest + drops.below_level + drops.timeout);
+      g_logger.reset();
+    }
+  }
+
+  Logger::Mode ModeArg(const benchmark::State &i_state)
+  {
+    return i_state.range(0) == 0 ? Logger::Mode::SYNC : Logger::Mode::ASYNC;
+  }
+
+  // Стоимость одного вызова в потоке-производителе
+  // ==============================================================================
+
+  void BM_LogString(benchmark::State &state)
+  {
+    SetupSharedLogger(state, ModeArg(state));
+    const std::string message = "request served in 0.250 ms by worker-7";
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(g_logger->Log(LoggerEvent::Level::INFO, message));
+    }
+    state.SetItemsProcessed(state.iterations());
+    TeardownSharedLogger(state);
+  }
+
+  void BM_LogFmt(benchmark::State &state)
+  {
+    SetupSharedLogger(state, ModeArg(state));
+    int i = 0;
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(g_logger->LogFmt(LoggerEvent::Level::INFO, "request %d served in %.3f ms by %s"
+                                                , i, i * 0.25, "worker-7"));
+      ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+    TeardownSharedLogger(state);
+  }
+
+  void BM_LogDeferred(benchmark::State &state)
+  {
+    SetupSharedLogger(state, ModeArg(state));
+    int i = 0;
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(g_logger->Log(LoggerEvent::Level::INFO, "request %d served in %.3f ms by %s"
+                                             , i, i * 0.25, "worker-7"));
+      ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+    TeardownSharedLogger(state);
+  }
+
+  void BM_LogFiltered(benchmark::State &state)
+  {
+    SetupSharedLogger(state, ModeArg(state));
+    int i = 0;
+    for (auto _ : state)
+    {
+      // Уровень TRACE не принимается обработчиком, аргументы не вычисляются
+      SLX_LOG_TRACE(*g_logger, "request %d served in %.3f ms by %s", i, i * 0.25, "worker-7");
+      benchmark::ClobberMemory();
+      ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+    TeardownSharedLogger(state);
+  }
+
+  void ProducerArgs(benchmark::internal::Benchmark *b)
+  {
+    b->ArgName("async")->Arg(0)->Arg(1)->ThreadRange(1, 64)->UseRealTime();
+  }
+
+  BENCHMARK(BM_LogString)->Apply(ProducerArgs);
+  BENCHMARK(BM_LogFmt)->Apply(ProducerArgs);
+  BENCHMARK(BM_LogDeferred)->Apply(ProducerArgs);
+  BENCHMARK(BM_LogFiltered)->Apply(ProducerArgs);
+
+  // Форматирование
+  // ==============================================================================
+
+  void BM_FormatData(benchmark::State &state)
+  {
+    int i = 0;
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(Logger::FormatData("request %d served in %.3f ms by %s", i, i * 0.25, "worker-7"));
+      ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+  BENCHMARK(BM_FormatData);
+
+  void BM_FormatTimestampString(benchmark::State &state)
+  {
+    std::time_t ts = std::time(nullptr);
+    int i = 0;
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(Logger::FormatTimestamp("%Y-%m-%d %H:%M:%S", ts));
+      // Метка меняется раз в несколько событий, как при обычном потоке событий
+      ts += (++i % 4 == 0);
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+  BENCHMARK(BM_FormatTimestampString);
+
+  void BM_FormatTimestampBuffer(benchmark::State &state)
+  {
+    char buffer[64];
+    std::time_t ts = std::time(nullptr);
+    int i = 0;
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(Logger::FormatTimestamp(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", ts));
+      ts += (++i % 4 == 0);
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+  BENCHMARK(BM_FormatTimestampBuffer);
+
+  void BM_FormatTimestampNs(benchmark::State &state)
+  {
+    char buffer[64];
+    std::int64_t ts = static_cast<std::int64_t>(std::time(nullptr)) * 1000000000;
+    for (auto _ : state)
+    {
+      benchmark::DoNotOptimize(Logger::FormatTimestampNs(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S.%9N", ts));
+      ts += 250000000;
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+  BENCHMARK(BM_FormatTimestampNs);
+
+  //! Строка события в формате обработчиков по умолчанию (0) и по шаблону Layout (1)
+  void BM_FormatLine(benchmark::State &state)
+  {
+    Layout layout("%d{%H:%M:%S.%6N} [%t] %-5l %n #%i %v%f");
+    LoggerEvent event;
+    event.level = LoggerEvent::Level::INFO;
+    event.time_ns = static_cast<std::int64_t>(std::time(nullptr)) * 1000000000;
+    event.thread_id = static_cast<std::uint32_t>(getpid());
+    event.logger_name = "bench";
+    event.data.assign("request 42 served in 10.500 ms by worker-7", 42);
+
+    std::string buffer;
+    for (auto _ : state)
+    {
+      buffer.clear();
+      if (state.range(0) == 0)
+      {
+        AppendDefaultLine(buffer, event);
+      }
+      else
+      {
+        layout.Append(buffer, event);
+      }
+      benchmark::DoNotOptimize(buffer.data());
+      event.time_ns += 250000000;
+      ++event.sequence;
+    }
+    state.SetItemsProcessed(state.iterations());
+  }
+  BENCHMARK(BM_FormatLine)->ArgName("layout")->Arg(0)->Arg(1);
+
+  // Пропускная способность обработчиков
+  // ==============================================================================
+
+  typedef std::function<tHandler(const std::string &)> HandlerFactory;
+
+  //! Итерация - THROUGHPUT_BATCH событий в режиме ASYNC и ожидание их записи
+  /*!
+    Переключение в режим SYNC дожидается обработки очереди, после чего обработчик сбрасывается.
+  */
+  void BM_HandlerThroughput(benchmark::State &state, HandlerFactory i_factory, std::string i_path)
+  {
+    bool regular = (i_path != "/dev/null");
+    if (regular == true)
+    {
+      unlink(i_path.c_str());
+    }
+
+    {
+      Logger logger(Logger::Mode::ASYNC);
+      tHandler handler = i_factory(i_path);
+      logger.AddHandler(handler);
+
+      for (auto _ : state)
+      {
+        for (int i = 0; i < THROUGHPUT_BATCH; ++i)
+        {
+          logger.Log(LoggerEvent::Level::INFO, "request %d served in %.3f ms by %s", i, i * 0.25, "worker-7");
+        }
+        logger.SetMode(Logger::Mode::SYNC);
+        handler->Flush();
+        logger.SetMode(Logger::Mode::ASYNC);
+      }
+
+      state.SetItemsProcessed(state.iterations() * THROUGHPUT_BATCH);
+    }
+    if (regular == true)
+    {
+      unlink(i_path.c_str());
+    }
+  }
+
+  void RegisterHandlerBenchmarks()
+  {
+    const std::string tmpfs = TmpfsDir();
+
+    struct Target
+    {
+      const char * name;
+      HandlerFactory factory;
+      bool dev_null;
+    };
+
+    const Target targets[] = {
+      {"HandlerFilename", [](const std::string & p) { return std::make_shared<HandlerFilename>(p); }, true}
+      , {"HandlerFILE", [](const std::string & p) {
+          // Файл закрывается при завершении процесса
+          return std::make_shared<HandlerFILE>(fopen(p.c_str(), "a"));
+        }, true}
+      , {"HandlerStream", [](const std::string & p) {
+          static std::vector<std::unique_ptr<std::ofstream>> streams;
+          streams.emplace_back(new std::ofstream(p, std::ios_base::app));
+          return std::make_shared<HandlerStream>(*streams.back());
+        }, true}
+      , {"HandlerJsonFile", [](const std::string & p) { return std::make_shared<HandlerJsonFile>(p); }, true}
+      , {"HandlerBinaryFile", [](const std::string & p) { return std::make_shared<HandlerBinaryFile>(p); }, true}
+      , {"HandlerUringFile", [](const std::string & p) { return std::make_shared<HandlerUringFile>(p); }, true}
+      , {"HandlerMmapFile", [](const std::string & p) { return std::make_shared<HandlerMmapFile>(p); }, false}
+      , {"HandlerRotatingFile", [](const std::string & p) {
+          HandlerRotatingFile::RotationPolicy policy;
+          policy.max_size = 64 * 1024 * 1024;
+          policy.generations = 1;
+          policy.compression = HandlerRotatingFile::Compression::NONE;
+          return std::make_shared<HandlerRotatingFile>(p, policy);
+        }, false}
+    };
+
+    for (const Target & target : targets)
+    {
+      if (target.dev_null == true)
+      {
+        benchmark::RegisterBenchmark((std::string("BM_HandlerThroughput/") + target.name + "/devnull").c_str()
+                                     , BM_HandlerThroughput, target.factory, std::string("/dev/null"))
+          ->UseRealTime();
+      }
+      benchmark::RegisterBenchmark((std::string("BM_HandlerThroughput/") + target.name + "/tmpfs").c_str()
+                                   , BM_HandlerThroughput, target.factory
+                                   , tmpfs + "/slx_bench_" + target.name + ".log")
+        ->UseRealTime();
+    }
+  }
+
+  // Распределение задержки вызова при конкуренции потоков
+  // ==============================================================================
+
+  std::int64_t Percentile(const std::vector<std::int64_t> &i_sorted, double i_quantile)
+  {
+    if (i_sorted.empty() == true)
+    {
+      return 0;
+    }
+    std::size_t index = static_cast<std::size_t>(i_quantile * static_cast<double>(i_sorted.size() - 1));
+    return i_sorted[index];
+  }
+
+  //! Каждый из range(1) потоков выполняет LATENCY_CALLS вызовов Log, время каждого вызова сохраняется
+  /*!
+    Потоки создаются внутри бенчмарка, чтобы собрать все замеры в одном месте.
+    Результат - счетчики p50, p99, p99.9 и max в наносекундах.
+  */
+  void BM_LogLatency(benchmark::State &state)
+  {
+    const int threads = static_cast<int>(state.range(1));
+    std::vector<std::int64_t> samples;
+    std::mutex samples_mtx;
+
+    for (auto _ : state)
+    {
+      Logger logger(ModeArg(state));
+      logger.AddHandler(std::make_shared<HandlerNull>());
+
+      std::vector<std::thread> producers;
+      for (int t = 0; t < threads; ++t)
+      {
+        producers.emplace_back([&logger, &samples, &samples_mtx]()
+        {
+          std::vector<std::int64_t> local;
+          local.reserve(LATENCY_CALLS);
+          for (int i = 0; i < LATENCY_CALLS; ++i)
+          {
+            auto start = std::chrono::steady_clock::now();
+            logger.Log(LoggerEvent::Level::INFO, "request %d served in %.3f ms by %s", i, i * 0.25, "worker-7");
+            auto end = std::chrono::steady_clock::now();
+            local.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+          }
+
+          std::unique_lock<std::mutex> samples_lock(samples_mtx);
+          samples.insert(samples.end(), local.begin(), local.end());
+        });
+      }
+      for (auto & producer : producers)
+      {
+        producer.join();
+      }
+    }
+
+    std::sort(samples.begin(), samples.end());
+    state.counters["p50_ns"] = static_cast<double>(Percentile(samples, 0.5));
+    state.counters["p99_ns"] = static_cast<double>(Percentile(samples, 0.99));
+    state.counters["p99.9_ns"] = static_cast<double>(Percentile(samples, 0.999));
+    state.counters["max_ns"] = static_cast<double>(samples.empty() == true ? 0 : samples.back());
+    state.SetItemsProcessed(static_cast<std::int64_t>(samples.size()));
+  }
+  BENCHMARK(BM_LogLatency)->ArgNames({"async", "threads"})
+    ->ArgsProduct({{0, 1}, {1, 4, 16, 64}})->Iterations(3)->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+int main(int argc, char **argv)
+{
+  RegisterHandlerBenchmarks();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv) == true)
+  {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
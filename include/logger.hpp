@@ -1,7 +1,6 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <list>
 #include <cstdarg>
 #include <unistd.h>
 #include <memory>
@@ -9,32 +8,178 @@
 #include <map>
 #include <fstream>
 #include <iomanip>
-#include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <atomic>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <ostream>
+
+#include "logger_ring_buffer.hpp"
+#include "logger_format.hpp"
+#include "logger_journal.hpp"
+#include "logger_stats.hpp"
 
 namespace slx
 {
   //! Бинарный семафор
   /*!
-   Реализация простейшего бинарного семафора для передачи сообщений потоку обработчику
-   В стандартной библиотеке семафоры появились только в c++20
+   Реализация простейшего бинарного семафора для передачи сообщений потоку обработчику.
+   Ожидает один поток. Перед засыпанием ожидающий поток недолго проверяет сигнал в цикле
+   (SPIN_COUNT итераций с инструкцией pause, затем YIELD_COUNT вызовов yield), после чего устанавливает флаг
+   сна и засыпает на futex. Notify выполняет системный вызов, только если ожидающий поток спит.
   */
   class BinarySemaphore
   {
   public:
+    //! Количество проверок сигнала с инструкцией pause перед засыпанием
+    static const unsigned SPIN_COUNT = 128;
+    //! Количество проверок сигнала с вызовом yield перед засыпанием
+    static const unsigned YIELD_COUNT = 8;
+
     explicit BinarySemaphore(bool i_val = false);
 
     void Notify();
 
     void Wait();
 
+    //! Ожидать сигнала не дольше i_timeout
+    /*!
+      \param i_timeout Максимальное время ожидания
+      \return true Сигнал получен
+      \return false Время ожидания истекло
+    */
+    bool WaitFor(std::chrono::microseconds i_timeout);
+
+  private:
+    //! Бит сигнала в state
+    static const std::uint32_t STATE_NOTIFIED = 1;
+    //! Бит сна ожидающего потока в state
+    static const std::uint32_t STATE_SLEEPING = 2;
+
+    //! Проверить сигнал в цикле перед засыпанием
+    /*!
+      \return true Сигнал получен и сброшен
+    */
+    bool SpinWait();
+
+    //! Заснуть до сигнала или истечения времени
+    /*!
+      \param i_timeout Максимальное время сна. nullptr - без ограничения
+      \return true Сигнал получен и сброшен
+    */
+    bool Park(const std::chrono::microseconds *i_timeout);
+
+    //! Слово futex: STATE_NOTIFIED | STATE_SLEEPING
+    std::atomic<std::uint32_t> state;
+  };
+
+  //! Строка данных события с внутренним буфером
+  /*!
+    Строки короче INLINE_CAPACITY хранятся внутри объекта, без выделения памяти в куче.
+    Более длинные строки хранятся в куче, выделенный буфер повторно используется при следующих присваиваниях.
+    Основная часть интерфейса повторяет std::string, чтобы обработчики могли работать с данными как со строкой.
+  */
+  class EventData
+  {
+  public:
+    //! Размер внутреннего буфера, включая завершающий ноль
+    static const std::size_t INLINE_CAPACITY = 128;
+
+    EventData();
+
+    EventData(const EventData &i_other);
+
+    EventData(EventData &&i_other) noexcept;
+
+    EventData(const std::string &i_str);
+
+    EventData(const char *i_str);
+
+    EventData & operator=(const EventData &i_other);
+
+    EventData & operator=(EventData &&i_other) noexcept;
+
+    EventData & operator=(const std::string &i_str);
+
+    EventData & operator=(const char *i_str);
+
+    //! Присвоить строку
+    /*!
+      \param i_data Указатель на данные
+      \param i_size Размер данных
+    */
+    void assign(const char *i_data, std::size_t i_size);
+
+    //! Добавить данные в конец строки
+    /*!
+      \param i_data Указатель на данные
+      \param i_size Размер данных
+    */
+    void append(const char *i_data, std::size_t i_size);
+
+    //! Очистить строку. Выделенный буфер сохраняется
+    void clear();
+
+    const char * data() const;
+
+    const char * c_str() const;
+
+    std::size_t size() const;
+
+    std::size_t length() const;
+
+    bool empty() const;
+
+    //! Получить копию данных в виде std::string
+    std::string str() const;
+
+    operator std::string() const;
+
+    //! Отформатировать строку прямо в буфер объекта
+    /*!
+      Формат аналогичен printf. Короткий результат не требует выделения памяти.
+      \param i_fmt Строка формата
+      \param i_args Параметры
+      \return true Успех
+      \return false Ошибка форматирования, строка пуста
+    */
+    bool Format(const char *i_fmt, va_list i_args);
+
   private:
-    std::mutex mtx;
-    std::condition_variable cv;
-    bool notified;
+    //! Обеспечить емкость буфера не меньше i_capacity байт
+    void Reserve(std::size_t i_capacity);
+
+    //! Данные, хранящиеся в куче, если строка не поместилась во внутренний буфер
+    std::unique_ptr<char[]> heap;
+    //! Размер буфера heap
+    std::size_t heap_capacity;
+    //! Длина строки
+    std::size_t len;
+    //! Данные хранятся в heap
+    bool on_heap;
+    //! Внутренний буфер
+    char inline_buffer[INLINE_CAPACITY];
+  };
+
+  std::ostream & operator<<(std::ostream &o_stream, const EventData &i_data);
+
+  //! Место вызова логирования
+  /*!
+    Создается макросами SLX_LOG как статическая константа, по одной на каждое место вызова,
+    поэтому строки не копируются, а событие содержит только указатель на описание.
+  */
+  struct SourceLocation
+  {
+    //! Имя файла (__FILE__)
+    const char * file;
+    //! Имя функции (__func__)
+    const char * function;
+    //! Номер строки
+    std::uint32_t line;
   };
 
   struct LoggerEvent
@@ -53,28 +198,161 @@ namespace slx
     //! Время события
     std::time_t time;
 
+    //! Время события в наносекундах от начала эпохи
+    std::int64_t time_ns = 0;
+
+    //! Порядковый номер события в логгере
+    /*!
+      Монотонно возрастает в пределах одного логгера, определяет точный порядок событий разных потоков
+    */
+    std::uint64_t sequence = 0;
+
+    //! Идентификатор потока операционной системы, создавшего событие
+    std::uint32_t thread_id = 0;
+
+    //! Имя логгера, создавшего событие (Logger::SetName). nullptr - имя не задано
+    /*!
+      Строка не освобождается до завершения процесса
+    */
+    const char * logger_name = nullptr;
+
+    //! Место вызова, создавшего событие. nullptr - неизвестно
+    /*!
+      Описание должно существовать до завершения процесса
+    */
+    const SourceLocation * location = nullptr;
+
     //! Данные события
     /*
       Строка, которую необходимо залогировать
     */
-    std::string data;
+    EventData data;
 
     //! Уровень важности события
     LoggerEvent::Level level;
+
+    //! Строка формата отложенного форматирования
+    /*!
+      Если не nullptr, то data заполняется потоком обработки из format и args перед вызовом обработчиков,
+      если текст нужен хотя бы одному обработчику (HandlerInterface::IsRenderRequired)
+    */
+    const char * format = nullptr;
+
+    //! Аргументы отложенного форматирования в двоичном представлении
+    EventData args;
+
+    //! Поля структурированного события в двоичном представлении
+    /*!
+      Записываются EncodeFields, читаются ReadField. Каждый обработчик формирует текст полей сам
+    */
+    EventData fields;
+
+    //! Кеш строк события, сформированных обработчиками
+    /*!
+      Первый обработчик, которому нужна строка в некотором формате, формирует ее в кеш,
+      остальные обработчики с тем же форматом копируют готовые байты (AppendCachedLine).
+      Строки всех форматов хранятся подряд в text, ends[i] - конец строки формата layouts[i].
+    */
+    struct RenderCache
+    {
+      //! Количество форматов, строки которых хранятся одновременно
+      static const std::size_t SLOTS = 2;
+
+      //! Строки событий подряд
+      std::string text;
+      //! Конец строки каждого формата в text
+      std::uint32_t ends[SLOTS] = {};
+      //! Номер формата каждой строки. 0 - строки нет
+      std::uint16_t layouts[SLOTS] = {};
+      //! Кеш используется
+      /*!
+        Включается логгером перед передачей события обработчикам, если их несколько и они
+        вызываются последовательно. Буфер text при этом не освобождается и используется повторно
+      */
+      bool enabled = false;
+
+      //! Очистить кеш
+      /*!
+        \param i_enabled Использовать кеш для следующей передачи события обработчикам
+      */
+      void Reset(bool i_enabled)
+      {
+        text.clear();
+        for (std::size_t i = 0; i < SLOTS; ++i)
+        {
+          layouts[i] = 0;
+        }
+        enabled = i_enabled;
+      }
+    };
+
+    //! Кеш строк события
+    /*!
+      Изменяется обработчиками при обработке константного события, поэтому mutable
+    */
+    mutable RenderCache render_cache;
   };
 
   typedef LoggerEvent::Level LogLVL;
 
+  //! Названия уровней, индекс - значение LoggerEvent::Level
+  constexpr std::string_view LOG_LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+
+  //! Получить название уровня
+  /*!
+    \param i_level Уровень
+    \return Название уровня
+  */
+  constexpr std::string_view GetLevelName(LoggerEvent::Level i_level)
+  {
+    return LOG_LEVEL_NAMES[static_cast<std::size_t>(i_level)];
+  }
+
   //! Текстовые константы для каждого уровня.
+  /*!
+    Оставлены для совместимости, для формирования строк используется GetLevelName
+  */
   extern const std::map<LoggerEvent::Level, std::string> g_log_level_strings;
 
+  class Logger;
+  class Layout;
+
   //! Абстрактный класс для описания интерфейса обработков событий
   /*!
     Потомки класса должны реализовывать метод HandlerFunction.
+    Обработка событий и сброс буферов сериализуются мютексом обработчика,
+    поэтому HandlerFunction и FlushFunction не вызываются одновременно из разных потоков.
   */
   class HandlerInterface
   {
   public:
+    //! Политика сброса буферов обработчика
+    /*!
+      Сброс выполняется, если выполнено любое из условий.
+    */
+    struct FlushPolicy
+    {
+      //! Сбрасывать после каждых every_n событий. 0 - не учитывать количество событий
+      std::size_t every_n = 1;
+      //! Сбрасывать, если с предыдущего сброса прошло не меньше interval. 0 - не учитывать время
+      std::chrono::milliseconds interval = std::chrono::milliseconds(0);
+      //! Сбрасывать сразу после события с уровнем не ниже level
+      LoggerEvent::Level level = LoggerEvent::Level::ERROR;
+    };
+
+    //! Статистика обработчика
+    struct Stats
+    {
+      //! Количество вызовов HandlerFunctionBatch
+      std::uint64_t calls = 0;
+      //! Количество событий, переданных в HandlerFunctionBatch
+      std::uint64_t events = 0;
+      //! Количество вызовов HandlerFunctionBatch, вернувших ошибку
+      std::uint64_t errors = 0;
+      //! Длительность вызовов HandlerFunctionBatch в наносекундах
+      LatencyHistogram::Snapshot call_time;
+    };
+
     HandlerInterface() = default;
 
     virtual ~HandlerInterface() = default;
@@ -82,11 +360,60 @@ namespace slx
     //! Обработать событие
     /*!
       Обрабатывает событие. Если событие ниже уровнем, чем log_level или обработчик неактивен, то событие игнорируется
-      Иначе вызывается метод HandlerFunction.
+      Иначе вызывается метод HandlerFunctionBatch.
       \return 0 Успех
     */
     int HandleEvent(const LoggerEvent &i_event);
 
+    //! Обработать пачку событий
+    /*!
+      Отбрасывает события ниже уровнем, чем log_level. Если обработчик неактивен, игнорирует всю пачку.
+      Оставшиеся события передаются одним вызовом HandlerFunctionBatch.
+      \param i_events Массив событий
+      \param i_count Количество событий
+      \return 0 Успех
+    */
+    int HandleEvents(const LoggerEvent *i_events, std::size_t i_count);
+
+    //! Сбросить буферы обработчика
+    void Flush();
+
+    //! Проверить, нужен ли обработчику текст события
+    /*!
+      Если текст не нужен ни одному обработчику логгера, события с отложенным форматированием
+      передаются без заполнения data, только с format и args.
+      \return true Обработчик использует data. По умолчанию true
+    */
+    virtual bool IsRenderRequired() const;
+
+    //! Проверить, нужен ли обработчику упорядоченный поток событий
+    /*!
+      В режиме ASYNC с несколькими потоками обработки (Logger::SetWorkerCount) события упорядочиваются
+      по порядковым номерам на общем этапе слияния. Обработчик, которому порядок не нужен,
+      получает события прямо из потоков очередей, минуя этап слияния.
+      \return true Обработчику нужен упорядоченный поток. По умолчанию true
+    */
+    virtual bool IsOrderRequired() const;
+
+    //! Сбросить буферы обработчика, если истек интервал политики сброса
+    /*!
+      Вызывается логгером периодически, чтобы сброс по времени выполнялся и при отсутствии новых событий.
+    */
+    void FlushIfDue();
+
+    //! Получить политику сброса
+    /*!
+      \return политика сброса
+    */
+    FlushPolicy GetFlushPolicy() const;
+
+    //! Установить политику сброса
+    /*!
+      По умолчанию буферы сбрасываются после каждого события.
+      \param i_policy политика сброса
+    */
+    void SetFlushPolicy(const FlushPolicy &i_policy);
+
     //! Получить уровень обработки событий
     /*!
       \return уровень обработки событий
@@ -119,7 +446,55 @@ namespace slx
     */
     void Disable();
 
+    //! Получить статистику обработчика
+    /*!
+      Счетчики накапливаются с момента создания обработчика и не блокируют обработку событий.
+      \return статистика
+    */
+    Stats GetStats() const;
+
+    //! Получить формат строк событий
+    /*!
+      \return формат строк. nullptr - формат обработчика по умолчанию
+    */
+    std::shared_ptr<const Layout> GetLayout();
+
+    //! Установить формат строк событий
+    /*!
+      Используется обработчиками, записывающими события в виде текстовых строк.
+      Один формат можно установить нескольким обработчикам.
+      \param i_layout Формат строк. nullptr - формат обработчика по умолчанию
+    */
+    void SetLayout(std::shared_ptr<const Layout> i_layout);
+
   protected:
+    friend class Logger;
+
+    //! Добавить в буфер строку события в формате обработчика
+    /*!
+      Вызывается из HandlerFunction и HandlerFunctionBatch.
+      \param o_buffer Буфер
+      \param i_event Событие
+      \param i_left_align Выравнивать название уровня по левому краю, если формат не установлен (AppendDefaultLine)
+    */
+    void AppendLine(std::string &o_buffer, const LoggerEvent &i_event, bool i_left_align = false) const;
+
+    //! Зарегистрировать логгер, использующий обработчик
+    /*!
+      Логгеры оповещаются об изменении уровня и статуса обработчика
+      \param i_logger Логгер
+    */
+    void AttachLogger(Logger *i_logger);
+
+    //! Удалить логгер из списка использующих обработчик
+    /*!
+      \param i_logger Логгер
+    */
+    void DetachLogger(Logger *i_logger);
+
+    //! Оповестить логгеры об изменении уровня или статуса обработчика
+    void NotifyLoggers();
+
     //! Метод обработки события
     /*!
       Содержит логику обработки события. Переопределяется в дочерних классах.
@@ -128,11 +503,66 @@ namespace slx
     */
     virtual int HandlerFunction(const LoggerEvent &i_event) = 0;
 
+    //! Метод обработки пачки событий
+    /*!
+      Переопределяется в дочерних классах, которые могут записать всю пачку за одну операцию.
+      По умолчанию вызывает HandlerFunction для каждого события.
+      \param i_events Массив указателей на события
+      \param i_count Количество событий
+      \return 0 Успех
+    */
+    virtual int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count);
+
+    //! Метод сброса буферов
+    /*!
+      Переопределяется в дочерних классах, которые буферизуют вывод. По умолчанию ничего не делает.
+    */
+    virtual void FlushFunction();
+
+    //! Учесть записанные события и определить, нужен ли сброс
+    /*!
+      \param i_events Массив указателей на записанные события
+      \param i_count Количество событий
+      \return true Нужно выполнить сброс. Счетчики политики сброса обнулены
+    */
+    bool FlushRequired(const LoggerEvent *const *i_events, std::size_t i_count);
+
     //! Уровень обработки событий
-    LoggerEvent::Level log_level = LoggerEvent::Level::TRACE;
+    /*!
+      Изменяется из любого потока, читается потоком обработки
+    */
+    std::atomic<LoggerEvent::Level> log_level{LoggerEvent::Level::TRACE};
 
     //! Флаг, контролирующий, активен ли обработчик
-    bool flag_enabled = true;
+    std::atomic<bool> flag_enabled{true};
+
+    //! Политика сброса буферов
+    FlushPolicy flush_policy;
+    //! Количество событий, записанных после последнего сброса
+    std::size_t unflushed_count = 0;
+    //! Время последнего сброса
+    std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+
+    //! Указатели на события текущей пачки, прошедшие фильтр уровня
+    std::vector<const LoggerEvent *> batch_events;
+
+    //! Формат строк событий. Изменяется под events_mtx
+    std::shared_ptr<const Layout> layout;
+
+    //! Счетчики статистики. Изменяются под events_mtx, читаются без блокировки
+    std::atomic<std::uint64_t> stats_calls{0};
+    std::atomic<std::uint64_t> stats_events{0};
+    std::atomic<std::uint64_t> stats_errors{0};
+    //! Длительность вызовов HandlerFunctionBatch
+    LatencyHistogram call_time;
+
+    //! Мютекс, сериализующий обработку событий, сброс буферов и доступ к flush_policy
+    mutable std::mutex events_mtx;
+
+    //! Логгеры, в которые добавлен обработчик
+    std::vector<Logger *> loggers;
+    //! Мютекс для синхронизации доступа к списку loggers
+    std::mutex loggers_mtx;
   };
 
   typedef std::shared_ptr<HandlerInterface> tHandler;
@@ -146,7 +576,61 @@ namespace slx
     {
       DISABLED = 0 //! Выключен
       , SYNC       //! Синхронный режим. События обратываются сразу
-      , ASYNC      //! Асинхронный режим. События добавляются в очередь, которую обрабатывает отдельный поток
+      , ASYNC      //! Асинхронный режим. События добавляются в очередь, которую обрабатывает отдельный поток (см. SetWorkerCount)
+      , ASYNC_BUFFERED //! Асинхронный режим. События накапливаются в буферах потоков и передаются пачками
+      , ASYNC_PER_HANDLER //! Асинхронный режим. Каждая группа обработчиков обслуживается собственным потоком
+    };
+
+    //! Источники времени событий
+    enum class ClockSource
+    {
+      REALTIME = 0      //! clock_gettime(CLOCK_REALTIME)
+      , REALTIME_COARSE //! clock_gettime(CLOCK_REALTIME_COARSE). Дешевле, точность порядка миллисекунд
+      , TSC             //! Счетчик тактов процессора, откалиброванный по CLOCK_REALTIME. Только x86
+    };
+
+    //! Политики поведения при переполнении очереди асинхронного режима
+    enum class OverflowPolicy
+    {
+      BLOCK = 0          //! Производитель ожидает освобождения места, но не дольше block_timeout
+      , DROP_NEWEST      //! Новое событие отбрасывается
+      , DROP_OLDEST      //! Самое старое событие в очереди вытесняется новым
+      , DROP_BELOW_LEVEL //! События ниже drop_level отбрасываются. Остальные вытесняют самое старое событие, только если оно ниже drop_level, иначе ожидают как при BLOCK
+    };
+
+    //! Счетчики событий, отброшенных при переполнении очереди
+    struct DropCounters
+    {
+      //! Отброшено новых событий (DROP_NEWEST)
+      std::uint64_t newest = 0;
+      //! Вытеснено старых событий (DROP_OLDEST, DROP_BELOW_LEVEL - только события ниже drop_level)
+      std::uint64_t oldest = 0;
+      //! Отброшено событий с уровнем ниже drop_level (DROP_BELOW_LEVEL)
+      std::uint64_t below_level = 0;
+      //! Отброшено событий по истечении времени ожидания (BLOCK, DROP_BELOW_LEVEL)
+      std::uint64_t timeout = 0;
+    };
+
+    //! Статистика логгера
+    struct Stats
+    {
+      //! Количество событий, принятых логгером (прошедших проверку уровня)
+      std::uint64_t logged = 0;
+      //! Количество событий, помещенных в очередь: logged за вычетом отброшенных
+      std::uint64_t enqueued = 0;
+      //! Количество событий, переданных обработчикам (в режиме ASYNC_PER_HANDLER - очередям групп)
+      std::uint64_t processed = 0;
+      //! Текущее количество событий в очереди асинхронного режима
+      std::size_t queue_depth = 0;
+      //! Максимальное количество событий в очереди (части очереди) асинхронного режима, измеренное при извлечении пачек
+      std::size_t queue_high_water = 0;
+      //! Отброшенные события
+      DropCounters drops;
+      //! Время от создания события до передачи обработчикам в наносекундах
+      /*!
+        Измеряется часами, выбранными SetClockSource
+      */
+      LatencyHistogram::Snapshot dispatch_latency;
     };
 
     enum ReturnCode
@@ -154,14 +638,43 @@ namespace slx
       RET_SUCCESS = 0
       , ERROR_HANDLER_NOT_UNIQUE
       , ERROR_HANDLER_NOT_FOUND
+      , ERROR_EVENT_DROPPED
+      , ERROR_JOURNAL_UNAVAILABLE
     };
 
+    //! Емкость очереди асинхронного режима по умолчанию
+    static const std::size_t DEFAULT_QUEUE_CAPACITY = 8192;
+
+    //! Максимальное количество событий, передаваемых обработчикам одной пачкой
+    static const std::size_t DEFAULT_BATCH_SIZE = 256;
+
+    //! Емкость буфера потока в режиме ASYNC_BUFFERED по умолчанию
+    static const std::size_t DEFAULT_STAGING_CAPACITY = 64;
+
+    //! Период принудительной передачи буферов потоков по умолчанию
+    static constexpr std::chrono::microseconds DEFAULT_FLUSH_INTERVAL = std::chrono::microseconds(1000);
+
+    //! Время ожидания политики BLOCK по умолчанию. Ожидание не ограничено
+    static constexpr std::chrono::milliseconds DEFAULT_BLOCK_TIMEOUT = std::chrono::milliseconds::max();
+
+    //! Максимальное количество необработанных событий группы обработчиков по умолчанию
+    static const std::size_t DEFAULT_HANDLER_BACKLOG = 65536;
+
+    //! Количество потоков обработки очереди режима ASYNC по умолчанию
+    static const std::size_t DEFAULT_WORKER_COUNT = 1;
+
+    //! Максимальное время сна потоков обработки по умолчанию
+    static constexpr std::chrono::microseconds DEFAULT_WORKER_MAX_SLEEP = std::chrono::microseconds(50000);
+
     //! Конструктор
     /*!
       Задает ражим работы логгера. По умолчанию синхронный режим.
+      Ячейки очереди асинхронного режима выделяются сразу, емкость округляется вверх до степени двойки.
       /param i_mode Режим работы логгера
+      \param i_queue_capacity Емкость очереди асинхронного режима
     */
-    explicit Logger(const Logger::Mode & i_mode = Logger::Mode::SYNC);
+    explicit Logger(const Logger::Mode & i_mode = Logger::Mode::SYNC
+                    , std::size_t i_queue_capacity = DEFAULT_QUEUE_CAPACITY);
 
     //! Деструктор
     /*!
@@ -182,6 +695,189 @@ namespace slx
     */
     void SetMode(const Logger::Mode & i_mode);
 
+    //! Получить емкость очереди асинхронного режима
+    /*!
+      \return емкость очереди
+    */
+    std::size_t GetQueueCapacity() const;
+
+    //! Получить количество потоков обработки очереди режима ASYNC
+    /*!
+      \return количество потоков
+    */
+    std::size_t GetWorkerCount() const;
+
+    //! Установить количество потоков обработки очереди режима ASYNC
+    /*!
+      Если потоков больше одного, очередь делится на i_count частей. Поток, вызывающий Log,
+      всегда пишет в одну и ту же часть, выбранную при первом вызове. Каждую часть обслуживает свой поток,
+      который формирует текст событий и передает их обработчикам без упорядочивания (IsOrderRequired() == false).
+      Затем пачки всех частей объединяются основным потоком обработки, сортируются по порядковым номерам
+      и передаются остальным обработчикам. Порядковый номер присваивается под блокировкой части,
+      поэтому события в каждой части упорядочены. Этап слияния передает обработчикам только события
+      с номерами меньше границы - наименьшего номера, который еще может прийти из какой-либо части,
+      более новые события ждут следующего прохода. Поэтому упорядоченные обработчики получают все события
+      в порядке номеров.
+      Емкость каждой части - емкость очереди, деленная на i_count, но не меньше DEFAULT_BATCH_SIZE.
+      Если логгер работает в режиме ASYNC, потоки перезапускаются, на время перезапуска события обрабатываются синхронно.
+      Как и SetMode, не должен вызываться одновременно с другими методами настройки и GetStats.
+      \param i_count количество потоков. 0 интерпретируется как 1
+    */
+    void SetWorkerCount(std::size_t i_count);
+
+    //! Получить имя логгера
+    /*!
+      \return имя логгера. Пустая строка - имя не задано
+    */
+    std::string GetName() const;
+
+    //! Установить имя логгера
+    /*!
+      Имя записывается в LoggerEvent::logger_name новых событий и выводится форматом строк (Layout, %n).
+      Копия имени хранится до завершения процесса, поэтому имена не должны создаваться динамически без ограничений.
+      \param i_name имя логгера. Пустая строка - без имени
+    */
+    void SetName(const std::string &i_name);
+
+    //! Получить источник времени событий
+    /*!
+      \return источник времени
+    */
+    Logger::ClockSource GetClockSource() const;
+
+    //! Установить источник времени событий
+    /*!
+      При первом выборе TSC выполняется калибровка, занимающая около 10 мс.
+      На платформах без TSC используется REALTIME.
+      \param i_source источник времени
+    */
+    void SetClockSource(Logger::ClockSource i_source);
+
+    //! Получить текущее время по источнику времени логгера
+    /*!
+      \return время в наносекундах от начала эпохи
+    */
+    std::int64_t GetTimeNs() const;
+
+    //! Получить емкость буфера потока
+    /*!
+      \return емкость буфера потока
+    */
+    std::size_t GetStagingCapacity() const;
+
+    //! Установить емкость буфера потока
+    /*!
+      В режиме ASYNC_BUFFERED заполненный буфер потока сразу передается потоку обработки.
+      \param i_capacity количество событий в буфере
+    */
+    void SetStagingCapacity(std::size_t i_capacity);
+
+    //! Получить период передачи буферов потоков
+    /*!
+      \return период передачи
+    */
+    std::chrono::microseconds GetFlushInterval() const;
+
+    //! Установить период передачи буферов потоков
+    /*!
+      В режиме ASYNC_BUFFERED поток обработки с этим периодом забирает неполные буферы потоков.
+      \param i_interval период передачи
+    */
+    void SetFlushInterval(std::chrono::microseconds i_interval);
+
+    //! Получить максимальное время сна потоков обработки
+    /*!
+      \return время сна
+    */
+    std::chrono::microseconds GetWorkerMaxSleep() const;
+
+    //! Установить максимальное время сна потоков обработки
+    /*!
+      Поток обработки просыпается по сигналу о новых событиях, но не реже одного раза за это время,
+      чтобы проверить политику сброса обработчиков. Поэтому сброс по времени выполняется с опозданием
+      не больше i_sleep. В режиме ASYNC_BUFFERED поток просыпается не реже периода передачи буферов.
+      По умолчанию DEFAULT_WORKER_MAX_SLEEP.
+      \param i_sleep время сна
+    */
+    void SetWorkerMaxSleep(std::chrono::microseconds i_sleep);
+
+    //! Получить политику переполнения очереди
+    /*!
+      \return политика переполнения
+    */
+    Logger::OverflowPolicy GetOverflowPolicy() const;
+
+    //! Установить политику переполнения очереди
+    /*!
+      Политика применяется только в асинхронных режимах. По умолчанию BLOCK.
+      В режиме ASYNC_BUFFERED политика применяется к событиям заполненного буфера потока: DROP_NEWEST отбрасывает
+      весь буфер, DROP_OLDEST вытесняет самые старые события переданных пачек, DROP_BELOW_LEVEL отбрасывает события буфера
+      ниже drop_level и вытесняет такие же события переданных пачек. Если места не хватает, производитель ожидает
+      обработки переданных пачек как при BLOCK.
+      \param i_policy политика переполнения
+    */
+    void SetOverflowPolicy(Logger::OverflowPolicy i_policy);
+
+    //! Получить время ожидания политики BLOCK
+    /*!
+      \return время ожидания
+    */
+    std::chrono::milliseconds GetBlockTimeout() const;
+
+    //! Установить время ожидания политики BLOCK
+    /*!
+      Если за это время место в очереди не освободилось, событие отбрасывается.
+      \param i_timeout время ожидания. DEFAULT_BLOCK_TIMEOUT - ожидать без ограничения
+    */
+    void SetBlockTimeout(std::chrono::milliseconds i_timeout);
+
+    //! Получить уровень политики DROP_BELOW_LEVEL
+    /*!
+      \return уровень
+    */
+    LoggerEvent::Level GetDropLevel() const;
+
+    //! Установить уровень политики DROP_BELOW_LEVEL
+    /*!
+      При переполнении события с уровнем ниже i_level отбрасываются,
+      события с уровнем не ниже i_level вытесняют самые старые события очереди.
+      \param i_level уровень
+    */
+    void SetDropLevel(LoggerEvent::Level i_level);
+
+    //! Получить счетчики отброшенных событий
+    /*!
+      \return счетчики
+    */
+    Logger::DropCounters GetDropCounters() const;
+
+    //! Получить статистику логгера
+    /*!
+      Счетчики накапливаются с момента создания логгера. Сбор статистики не требует блокировок.
+      Статистику обработчиков возвращает HandlerInterface::GetStats.
+      \return статистика
+    */
+    Logger::Stats GetStats() const;
+
+    //! Проверить, будет ли обработано событие с уровнем i_level
+    /*!
+      Проверка не требует блокировок и выполняется до формирования события.
+      \param i_level Уровень события
+      \return true Логгер включен и хотя бы один активный обработчик принимает события этого уровня
+    */
+    bool IsLevelEnabled(LoggerEvent::Level i_level) const
+    {
+      return mode.load(std::memory_order_relaxed) != Logger::Mode::DISABLED
+             && (level_mask.load(std::memory_order_relaxed) & (1u << static_cast<unsigned>(i_level))) != 0;
+    }
+
+    //! Пересчитать маску уровней, принимаемых обработчиками
+    /*!
+      Вызывается автоматически при добавлении и удалении обработчиков,
+      а также при изменении уровня или статуса обработчика.
+    */
+    void UpdateLevelMask();
+
     //! Получить количество обработчиков
     /*!
       \return количество обработчиков
@@ -198,7 +894,7 @@ namespace slx
 
     //! Добавить обработчик
     /*!
-      Добавляет новый обработчик, если его еще нет.
+      Добавляет новый обработчик, если его еще нет. Не ожидает завершения обработки текущих событий.
       \param i_handler обработчик
       \return RET_SUCCESS Успех
       \return ERROR_HANDLER_NOT_UNIQUE Обработчик уже есть
@@ -207,6 +903,8 @@ namespace slx
 
     //! Удалить обработчик
     /*!
+      Дожидается завершения обработки событий, начатой до удаления, поэтому после возврата обработчик
+      не вызывается. Может вызываться из обработчика, в этом случае его собственный вызов не ожидается.
       \param i_handler обработчик
       \return RET_SUCCESS Успех
       \return ERROR_HANDLER_NOT_FOUND Обработчик не найден
@@ -221,18 +919,80 @@ namespace slx
     */
     ReturnCode DelHandlerByIndex(std::size_t i_index);
 
+    //! Назначить группу обработчика
+    /*!
+      В режиме ASYNC_PER_HANDLER каждая группа обработчиков имеет собственную очередь и поток,
+      поэтому медленный обработчик задерживает только обработчики своей группы.
+      По умолчанию каждый обработчик находится в отдельной группе.
+      Перед переносом ожидается обработка событий, уже переданных группам.
+      \param i_handler обработчик
+      \param i_group имя группы. Пустая строка - отдельная группа
+      \return RET_SUCCESS Успех
+      \return ERROR_HANDLER_NOT_FOUND Обработчик не найден
+    */
+    ReturnCode SetHandlerGroup(const tHandler &i_handler, const std::string &i_group);
+
+    //! Установить максимальное количество необработанных событий группы обработчика
+    /*!
+      Если очередь группы переполнена, новые пачки событий отбрасываются для всех обработчиков группы.
+      По умолчанию DEFAULT_HANDLER_BACKLOG.
+      \param i_handler обработчик
+      \param i_limit количество событий
+      \return RET_SUCCESS Успех
+      \return ERROR_HANDLER_NOT_FOUND Обработчик не найден
+    */
+    ReturnCode SetHandlerBacklog(const tHandler &i_handler, std::size_t i_limit);
+
+    //! Получить количество событий, отброшенных из-за переполнения очереди группы обработчика
+    /*!
+      \param i_handler обработчик
+      \return количество событий. 0 если обработчик не найден
+    */
+    std::uint64_t GetHandlerDropCount(const tHandler &i_handler);
+
+    //! Включить журнал событий очереди
+    /*!
+      В режимах ASYNC и ASYNC_PER_HANDLER каждое событие перед помещением в очередь копируется в файл,
+      отображенный в память (см. EventJournal), и остается там, пока не будет передано обработчикам
+      (в режиме ASYNC_PER_HANDLER - очередям групп). Поэтому события, не обработанные к моменту
+      аварийного завершения процесса, не теряются.
+      Если файл содержит события, не обработанные в предыдущем запуске, они передаются текущим обработчикам
+      в вызывающем потоке до возврата из функции. Вызывать следует после добавления обработчиков
+      и до начала логирования. Журнал нельзя отключить или заменить.
+      \param i_filename Имя файла журнала
+      \param i_capacity Количество ячеек журнала. Должно быть не меньше емкости очереди
+      \param o_recovered Количество восстановленных событий. Может быть nullptr
+      \return RET_SUCCESS Успех
+      \return ERROR_JOURNAL_UNAVAILABLE Журнал уже включен, файл не удалось открыть
+                                        или файл непустой и не является журналом
+    */
+    ReturnCode EnableJournal(const std::string &i_filename, std::size_t i_capacity = DEFAULT_QUEUE_CAPACITY
+                             , std::size_t *o_recovered = nullptr);
+
     //! Залогировать сообщение
     /*!
       \param i_level Уровень сообщения
       \param i_data Сообщение для логирования
       \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено из-за переполнения очереди
     */
     ReturnCode Log(LoggerEvent::Level i_level, const std::string &i_data);
 
+    //! Залогировать сообщение с указанием места вызова
+    /*!
+      Вызывается макросами SLX_LOG.
+      \param i_location Место вызова. nullptr - неизвестно
+      \param i_level Уровень сообщения
+      \param i_data Сообщение для логирования
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено из-за переполнения очереди
+    */
+    ReturnCode Log(const SourceLocation *i_location, LoggerEvent::Level i_level, const std::string &i_data);
+
     //! Залогировать сообщение с форматом
     /*!
       Формат аналогичен printf.
-      Внутри себя вызывает метод Log
+      Сообщение форматируется прямо в буфер события, короткие сообщения не требуют выделения памяти.
       \param i_level Уровень сообщения
       \param i_fmt Строка формата
       \param ... Опциональные параметры
@@ -240,10 +1000,85 @@ namespace slx
     */
     ReturnCode LogFmt(LoggerEvent::Level i_level, const char *i_fmt, ...);
 
+    //! Залогировать сообщение с форматом, проверяемым во время компиляции
+    /*!
+      Формат аналогичен printf. Соответствие спецификаторов типам аргументов проверяется при компиляции.
+      Аргументы копируются в событие в двоичном виде, текст формируется потоком обработки.
+      В синхронном режиме текст формируется сразу.
+      \param i_level Уровень сообщения
+      \param i_fmt Строка формата
+      \param i_arg, i_args Аргументы
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено из-за переполнения очереди
+    */
+    template<typename T, typename... Args>
+    ReturnCode Log(LoggerEvent::Level i_level
+                   , FormatString<std::type_identity_t<T>, std::type_identity_t<Args>...> i_fmt
+                   , T &&i_arg, Args &&... i_args)
+    {
+      return Log(nullptr, i_level, i_fmt, std::forward<T>(i_arg), std::forward<Args>(i_args)...);
+    }
+
+    //! Залогировать сообщение с форматом, проверяемым во время компиляции, с указанием места вызова
+    /*!
+      Вызывается макросами SLX_LOG.
+      \param i_location Место вызова. nullptr - неизвестно
+      \param i_level Уровень сообщения
+      \param i_fmt Строка формата
+      \param i_arg, i_args Аргументы
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено из-за переполнения очереди
+    */
+    template<typename T, typename... Args>
+    ReturnCode Log(const SourceLocation *i_location, LoggerEvent::Level i_level
+                   , FormatString<std::type_identity_t<T>, std::type_identity_t<Args>...> i_fmt
+                   , T &&i_arg, Args &&... i_args)
+    {
+      if (IsLevelEnabled(i_level) == false)
+      {
+        return RET_SUCCESS;
+      }
+
+      LoggerEvent event;
+      event.level = i_level;
+      event.location = i_location;
+      event.format = i_fmt.Get();
+      EncodeFormatArgs(event.args, i_arg, i_args...);
+
+      return LogDeferred(std::move(event));
+    }
+
+    //! Залогировать структурированное событие
+    /*!
+      Поля копируются в событие в двоичном виде, без выделения памяти на каждое поле.
+      Текстовые обработчики выводят поля после сообщения в виде key=value.
+      Пример: LogFields(LogLVL::INFO, "request done", Field("request_id", id), Field("latency_us", latency))
+      \param i_level Уровень сообщения
+      \param i_message Сообщение
+      \param i_fields Поля, созданные функцией Field
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено из-за переполнения очереди
+    */
+    template<typename... T>
+    ReturnCode LogFields(LoggerEvent::Level i_level, std::string_view i_message, const LogField<T> &... i_fields)
+    {
+      if (IsLevelEnabled(i_level) == false)
+      {
+        return RET_SUCCESS;
+      }
+
+      LoggerEvent event;
+      event.level = i_level;
+      event.data.assign(i_message.data(), i_message.size());
+      EncodeFields(event.fields, i_fields...);
+
+      return LogDeferred(std::move(event));
+    }
+
     //! Отфоматировать метку времени
     /*!
       Формат аналогичен std::strftime.
-      Внутри себя вызывает метод FormatTimestamp(const char *, const std::tm *)
+      Внутри себя вызывает метод FormatTimestamp(char *, std::size_t, const char *, std::time_t)
       \param i_fmt Строка формата
       \param i_ts Мтека времени
       \return строка с отформатированной меткой времени
@@ -259,6 +1094,36 @@ namespace slx
     */
     static std::string FormatTimestamp(const char *i_fmt, const std::tm *i_tm);
 
+    //! Отфоматировать метку времени в буфер
+    /*!
+      Формат аналогичен std::strftime. Использует localtime_r.
+      Результат кешируется для каждого потока отдельно для нескольких последних строк формата
+      и повторно используется, пока не сменится секунда. Память не выделяется.
+      \param o_buffer Буфер для результата
+      \param i_size Размер буфера
+      \param i_fmt Строка формата
+      \param i_ts Мтека времени
+      \return длина результата без завершающего нуля
+      \return 0 Результат не поместился в буфер
+    */
+    static std::size_t FormatTimestamp(char *o_buffer, std::size_t i_size, const char *i_fmt, std::time_t i_ts);
+
+    //! Отфоматировать метку времени с долями секунды в буфер
+    /*!
+      Формат аналогичен std::strftime с дополнительными спецификаторами:
+      %3N и %ms - миллисекунды, %6N и %us - микросекунды, %9N и %N - наносекунды.
+      Поэтому %m и %u, за которыми следует 's', выводят доли секунды, а не месяц и день недели.
+      Часть метки с точностью до секунды кешируется так же, как в FormatTimestamp.
+      Длинные форматы и результаты, не помещающиеся в кеш, форматируются без кеша.
+      \param o_buffer Буфер для результата
+      \param i_size Размер буфера
+      \param i_fmt Строка формата
+      \param i_time_ns Мтека времени в наносекундах от начала эпохи
+      \return длина результата без завершающего нуля
+      \return 0 Результат не поместился в буфер
+    */
+    static std::size_t FormatTimestampNs(char *o_buffer, std::size_t i_size, const char *i_fmt, std::int64_t i_time_ns);
+
     //! Отформатировать сообщение
     /*!
       Формат аналогичен printf.
@@ -280,30 +1145,392 @@ namespace slx
     static std::string FormatData(const char *i_fmt, va_list i_args);
 
   protected:
+    //! Буфер событий одного потока-производителя для режима ASYNC_BUFFERED
+    struct StagingBuffer;
+
+    //! Читатель списка обработчиков
+    /*!
+      Пока объект существует, снимок списка обработчиков не освобождается.
+    */
+    struct HandlersReader;
+
+    //! Опубликовать новый снимок списка обработчиков
+    /*!
+      Вызывается под handlers_mtx. Не ожидает читателей: предыдущий снимок помещается в handlers_retired
+      и освобождается, когда читателей нет, или в ReclaimHandlers.
+      \param i_handlers Новый снимок
+    */
+    void PublishHandlers(std::vector<tHandler> *i_handlers);
+
+    //! Дождаться завершения читателей списка обработчиков, начавших работу до вызова
+    /*!
+      Вызывается без handlers_mtx. Читатели вызывающего потока не ожидаются.
+      \return true Вызывающий поток сам является читателем списка
+    */
+    bool WaitHandlersReaders();
+
+    //! Дождаться читателей и освободить снимки handlers_retired
+    /*!
+      Вызывается без handlers_mtx при удалении обработчика. Если вызывающий поток сам читает список
+      (удаление из обработчика), снимки остаются в handlers_retired.
+    */
+    void ReclaimHandlers();
+
+    //! Группа обработчиков режима ASYNC_PER_HANDLER
+    struct HandlerGroup;
+
+    //! Часть очереди режима ASYNC со своим потоком обработки
+    struct QueueShard;
+
+    //! Набор частей очереди для одного количества потоков
+    /*!
+      Наборы не освобождаются до уничтожения логгера, поэтому поток-производитель может обращаться
+      к части, даже если набор в это время остановлен.
+    */
+    struct ShardSet;
+
+    //! Пачка событий части очереди, ожидающая слияния
+    struct MergeBatch
+    {
+      std::vector<LoggerEvent> events;
+      //! Текст событий сформирован потоком части очереди
+      bool rendered = false;
+    };
+
+    //! Запустить потоки частей очереди
+    /*!
+      Используется набор с количеством частей worker_count, при отсутствии он создается.
+      Вызывается из SetMode при переходе в режим ASYNC.
+    */
+    void StartShards();
+
+    //! Остановить потоки частей очереди и передать оставшиеся события на слияние
+    void StopShards();
+
+    //! Извлечь события из части очереди, передать их неупорядоченным обработчикам и на слияние
+    /*!
+      \param io_shard часть очереди
+      \param i_wait ожидать, пока этап слияния не освободит место
+      \return true События были извлечены
+    */
+    bool DrainShard(QueueShard &io_shard, bool i_wait);
+
+    //! Объединить пачки частей очереди, отсортировать по порядковым номерам и передать упорядоченным обработчикам
+    /*!
+      Передаются только события с номерами меньше GetMergeWatermark, остальные остаются в merge_held.
+    */
+    void DrainMergeBatches();
+
+    //! Получить границу этапа слияния
+    /*!
+      \return наименьший номер события, которое еще может быть передано на слияние какой-либо частью
+    */
+    std::uint64_t GetMergeWatermark();
+
+    //! Найти группу обработчика
+    /*!
+      Вызывается под groups_mtx.
+      \param i_handler обработчик
+      \return группа. nullptr если обработчик не найден
+    */
+    HandlerGroup * FindHandlerGroup(const HandlerInterface *i_handler);
+
+    //! Добавить обработчик в группу
+    /*!
+      Вызывается под groups_mtx. Группа с пустым именем создается для каждого обработчика отдельно.
+      \param i_handler обработчик
+      \param i_group имя группы
+    */
+    void JoinHandlerGroup(const tHandler &i_handler, const std::string &i_group);
+
+    //! Удалить обработчик из его группы
+    /*!
+      Вызывается под groups_mtx. Пустая группа удаляется.
+      \param i_handler обработчик
+    */
+    void LeaveHandlerGroup(const HandlerInterface *i_handler);
+
+    //! Запустить поток группы
+    void StartHandlerGroup(HandlerGroup &io_group);
+
+    //! Остановить поток группы
+    /*!
+      Ожидает обработки всех событий, переданных группе.
+    */
+    void StopHandlerGroup(HandlerGroup &io_group);
+
+    //! Передать пачку событий всем группам обработчиков
+    /*!
+      События перемещаются в одну общую пачку, группы разделяют владение ею.
+      Если очередь группы переполнена, пачка для нее отбрасывается.
+      \param i_events Массив событий
+      \param i_count Количество событий
+    */
+    void FanOutEvents(LoggerEvent *i_events, std::size_t i_count);
+
+    //! Проверить, нужен ли текст событий хотя бы одному обработчику
+    /*!
+      \param i_handlers Обработчики
+      \return true Текст нужен
+    */
+    static bool IsRenderRequired(const std::vector<tHandler> &i_handlers);
+
     //! Обработать событие
     /*!
       Обрабатывает событие путем вызова всех обработчкиов
       \param i_event Событие
       \return RET_SUCCESS Успех
     */
-    ReturnCode ProcessEvent(const LoggerEvent &i_event);
+    ReturnCode ProcessEvent(LoggerEvent &i_event);
+
+    //! Обработать пачку событий
+    /*!
+      Передает всю пачку каждому обработчику одним вызовом HandleEvents.
+      Перед этим формирует текст событий с отложенным форматированием, если он нужен хотя бы одному обработчику.
+      \param i_events Массив событий
+      \param i_count Количество событий
+      \return RET_SUCCESS Успех
+    */
+    ReturnCode ProcessEvents(LoggerEvent *i_events, std::size_t i_count);
+
+    //! Сбросить буферы обработчиков, у которых истек интервал политики сброса
+    void FlushHandlers();
+
+    //! Поместить событие в очередь асинхронного режима
+    /*!
+      Присваивает событию порядковый номер. Если работают части очереди, номер присваивается
+      и событие помещается в часть под ее блокировкой.
+      \param i_event Событие
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено
+    */
+    ReturnCode EnqueueEvent(LoggerEvent &&i_event);
+
+    //! Поместить событие с присвоенным номером в очередь или часть очереди
+    /*!
+      Записывает событие в журнал и при переполнении очереди применяет политику overflow_policy.
+      \param io_queue Очередь
+      \param io_sem Семафор потока, обрабатывающего очередь
+      \param d_shard Часть очереди, которой принадлежит io_queue. nullptr - events_queue
+      \param i_event Событие
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено
+    */
+    ReturnCode PushEvent(RingBuffer<LoggerEvent> &io_queue, BinarySemaphore &io_sem, QueueShard *d_shard
+                         , LoggerEvent &&i_event);
+
+    //! Передать событие на обработку в соответствии с режимом работы
+    /*!
+      Событие перемещается, данные не копируются.
+      \param i_event Событие
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено
+    */
+    ReturnCode DispatchEvent(LoggerEvent &&i_event);
+
+    //! Заполнить время, поток и имя логгера события
+    /*!
+      Порядковый номер присваивается в DispatchEvent.
+      \param io_event Событие
+    */
+    void StampEvent(LoggerEvent &io_event);
+
+    //! Учесть события, переданные на обработку
+    /*!
+      Обновляет счетчик processed и гистограмму dispatch_latency.
+      \param i_events Массив событий
+      \param i_count Количество событий
+    */
+    void RecordDispatch(const LoggerEvent *i_events, std::size_t i_count);
+
+    //! Обновить queue_high_water
+    /*!
+      Вызывается потоком обработки при извлечении пачки, чтобы не нагружать потоки-производители.
+      \param i_depth Размер очереди или части очереди: извлеченная пачка и оставшиеся события
+    */
+    void UpdateQueueHighWater(std::size_t i_depth);
+
+    //! Завершить заполнение события с отложенным форматированием и передать на обработку
+    /*!
+      \param i_event Событие с заполненными level, format и args
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено
+    */
+    ReturnCode LogDeferred(LoggerEvent &&i_event);
+
+    //! Сформировать текст события с отложенным форматированием
+    /*!
+      Заполняет data по format и args. format и args сохраняются. События без format не изменяются.
+      \param io_event Событие
+    */
+    static void RenderEvent(LoggerEvent &io_event);
+
+    //! Поместить событие в буфер текущего потока
+    /*!
+      Используется в режиме ASYNC_BUFFERED. Заполненный буфер передается потоку обработки.
+      \param i_event Событие
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Событие отброшено
+    */
+    ReturnCode StageEvent(LoggerEvent &&i_event);
+
+    //! Получить буфер текущего потока
+    /*!
+      При первом обращении из потока создает буфер и регистрирует его в staging_buffers.
+      \return буфер текущего потока
+    */
+    StagingBuffer & GetStagingBuffer();
+
+    //! Передать пачку событий потоку обработки
+    /*!
+      Если пачка не помещается, политика overflow_policy применяется к каждому событию пачки.
+      \param io_batch Пачка событий. На выходе пустой вектор для повторного заполнения
+      \return RET_SUCCESS Успех
+      \return ERROR_EVENT_DROPPED Пачка или часть ее событий отброшена
+    */
+    ReturnCode PublishBatch(std::vector<LoggerEvent> &io_batch);
+
+    //! Вытеснить самые старые события из published_batches
+    /*!
+      Вызывается под batches_mtx.
+      \param i_count Максимальное количество вытесняемых событий
+      \param i_limit Вытесняются только события с уровнем ниже i_limit
+      \return количество вытесненных событий
+    */
+    std::size_t EvictPublished(std::size_t i_count, unsigned i_limit);
+
+    //! Обработать все события из очереди events_queue
+    /*!
+      События извлекаются пачками не больше DEFAULT_BATCH_SIZE и передаются в ProcessEvents
+    */
+    void DrainQueue();
+
+    //! Обработать все переданные пачки и содержимое буферов потоков
+    /*!
+      События всех пачек объединяются и обрабатываются в порядке порядковых номеров.
+    */
+    void DrainStagingBuffers();
+
+    //! Проверить, является ли режим асинхронным
+    /*!
+      \param i_mode режим работы
+      \return true режим асинхронный
+    */
+    static bool IsAsyncMode(Logger::Mode i_mode);
 
     //! Функция для потока-обработчика очереди
     /*!
-      В цикле ожидает сигнала от семафора worker_sem
-      Если очередь events_queue не пуста, обрабатывает каждый ее элемент методом ProcessEvent
+      В цикле ожидает сигнала от семафора worker_sem, но не дольше flush_interval
+      Извлекает из очереди events_queue все события и обрабатывает их пачками методом ProcessEvents
+      В режиме ASYNC_BUFFERED забирает буферы потоков
+      После обработки проверяет политику сброса обработчиков
       Если worker_active == false завержает работу
       \param d_logger Указатель на собственный объект класса
     */
     static void QueueWorker(Logger * d_logger);
 
+    //! Получить время ожидания сигнала потоками обработки в текущем режиме
+    std::chrono::microseconds GetWorkerSleep() const;
+
+    //! Функция для потока части очереди
+    /*!
+      \param d_logger Указатель на собственный объект класса
+      \param d_shard Часть очереди потока
+    */
+    static void ShardWorker(Logger * d_logger, QueueShard * d_shard);
+
+    //! Функция для потока группы обработчиков
+    /*!
+      Ожидает пачки событий в очереди группы, но не дольше flush_interval, передает их обработчикам группы
+      и проверяет политику сброса обработчиков. При остановке обрабатывает оставшиеся пачки и завершает работу.
+      \param d_logger Указатель на собственный объект класса
+      \param d_group Группа
+    */
+    static void GroupWorker(Logger * d_logger, HandlerGroup * d_group);
+
     //! Режим работы логгера
-    Logger::Mode mode = Logger::Mode::DISABLED;
+    std::atomic<Logger::Mode> mode;
+
+    //! Уникальный номер экземпляра логгера. Служит ключом буферов потоков
+    const std::uint64_t instance_id;
+
+    //! Источник времени событий
+    std::atomic<Logger::ClockSource> clock_source;
+
+    //! Имя логгера, полученное InternString. nullptr - имя не задано
+    std::atomic<const char *> name;
+
+    //! Порядковый номер следующего события
+    alignas(64) std::atomic<std::uint64_t> next_sequence;
+
+    //! Маска уровней, принимаемых хотя бы одним активным обработчиком
+    /*!
+      Бит с номером уровня установлен, если событие этого уровня будет обработано.
+      Если активных обработчиков нет, маска пустая
+    */
+    alignas(64) std::atomic<unsigned> level_mask;
+    //! Мютекс, сериализующий пересчет level_mask
+    std::mutex level_mask_mtx;
 
     //! Очередь событий
-    std::queue<LoggerEvent> events_queue;
-    //! Мютекс для синхронизации доступа к очереди events_queue
-    std::mutex queue_mtx;
+    /*!
+      Lock-free очередь с заранее выделенными ячейками.
+      Заполняется потоками, вызывающими Log, разбирается потоком worker_thread
+    */
+    RingBuffer<LoggerEvent> events_queue;
+
+    //! Политика переполнения очереди
+    std::atomic<Logger::OverflowPolicy> overflow_policy;
+    //! Время ожидания политики BLOCK в миллисекундах
+    std::atomic<std::chrono::milliseconds::rep> block_timeout;
+    //! Уровень политики DROP_BELOW_LEVEL
+    std::atomic<LoggerEvent::Level> drop_level;
+
+    //! Счетчики отброшенных событий
+    std::atomic<std::uint64_t> dropped_newest;
+    std::atomic<std::uint64_t> dropped_oldest;
+    std::atomic<std::uint64_t> dropped_below_level;
+    std::atomic<std::uint64_t> dropped_timeout;
+
+    //! Количество событий, переданных обработчикам
+    std::atomic<std::uint64_t> stats_processed;
+    //! Максимальное количество событий в очереди events_queue
+    std::atomic<std::size_t> queue_high_water;
+    //! Время от создания события до передачи обработчикам
+    LatencyHistogram dispatch_latency;
+
+    //! Журнал событий очереди. nullptr - журнал не включен
+    /*!
+      Устанавливается один раз, освобождается в деструкторе
+    */
+    std::atomic<EventJournal *> journal;
+    //! Мютекс, сериализующий EnableJournal
+    std::mutex journal_mtx;
+
+    //! Буферы потоков режима ASYNC_BUFFERED. Пустые буферы завершившихся потоков удаляются в DrainStagingBuffers
+    std::vector<std::shared_ptr<StagingBuffer>> staging_buffers;
+    //! Мютекс для синхронизации доступа к списку staging_buffers
+    std::mutex staging_mtx;
+    //! Емкость буфера потока
+    std::atomic<std::size_t> staging_capacity;
+    //! Период передачи буферов потоков в микросекундах
+    std::atomic<std::chrono::microseconds::rep> flush_interval;
+    //! Максимальное время сна потоков обработки в микросекундах
+    std::atomic<std::chrono::microseconds::rep> worker_max_sleep;
+
+    //! Пачки событий, переданные потоками, но еще не обработанные
+    std::vector<std::vector<LoggerEvent>> published_batches;
+    //! Пустые векторы для повторного использования в качестве буферов
+    std::vector<std::vector<LoggerEvent>> spare_batches;
+    //! Количество событий в published_batches и в пачках, забранных потоком обработки. Изменяется под batches_mtx
+    std::atomic<std::size_t> published_count;
+    //! Мютекс для синхронизации доступа к published_batches и spare_batches
+    std::mutex batches_mtx;
+    //! Оповещение производителей, ожидающих места для пачки, об уменьшении published_count
+    std::condition_variable published_cv;
+
+    //! Пачка событий, извлеченных потоком обработки из events_queue
+    std::vector<LoggerEvent> drain_batch;
 
     //! Поток обработки очереди events_queue
     std::thread worker_thread;
@@ -312,11 +1539,103 @@ namespace slx
     //! Контроль работы потока
     std::atomic<bool> worker_active;
 
-    //! Список обработчиков событий логгера
-    std::list<tHandler> handlers;
-    //! Мютекс для синхронизации доступа к списку handlers
+    //! Снимок списка обработчиков событий логгера
+    /*!
+      Снимок не изменяется после публикации. При добавлении и удалении обработчика создается новый снимок,
+      который подменяет текущий атомарно, поэтому обработка событий читает список без блокировки.
+      Старый снимок освобождается после завершения всех читателей, начавших работу до подмены.
+    */
+    std::atomic<std::vector<tHandler> *> handlers;
+    //! Замененные снимки, которые еще могут использоваться читателями. Изменяется под handlers_mtx
+    std::vector<std::vector<tHandler> *> handlers_retired;
+    //! Эпоха читателей списка обработчиков. Меняется при каждой публикации снимка
+    std::atomic<unsigned> handlers_epoch;
+    //! Количество активных читателей для четной и нечетной эпохи
+    std::atomic<std::size_t> handlers_readers[2];
+    //! Мютекс, сериализующий изменения списка handlers
     std::mutex handlers_mtx;
+
+    //! Количество потоков обработки очереди режима ASYNC
+    std::atomic<std::size_t> worker_count;
+    //! Созданные наборы частей очереди. Изменяется только в SetMode
+    std::vector<std::unique_ptr<ShardSet>> shard_sets;
+    //! Последний запущенный набор частей. nullptr - части не запускались
+    std::atomic<ShardSet *> shard_set;
+
+    //! Пачки частей очереди, ожидающие слияния
+    std::vector<MergeBatch> merge_batches;
+    //! Пустые векторы для повторного использования в качестве пачек частей очереди
+    std::vector<std::vector<LoggerEvent>> merge_spare;
+    //! Количество событий в merge_batches
+    std::atomic<std::size_t> merge_count;
+    //! Мютекс для синхронизации доступа к merge_batches и merge_spare
+    std::mutex merge_mtx;
+    //! События, забранные этапом слияния, но не переданные из-за границы. Используется только потоком обработки
+    std::vector<LoggerEvent> merge_held;
+    //! Количество событий в merge_held
+    std::atomic<std::size_t> merge_held_count;
+
+    //! Группы обработчиков режима ASYNC_PER_HANDLER
+    std::vector<std::unique_ptr<HandlerGroup>> handler_groups;
+    //! Потоки групп запущены
+    bool groups_running;
+    //! Мютекс для синхронизации доступа к handler_groups
+    std::mutex groups_mtx;
   };
 }
 
+//! Минимальный уровень событий, компилируемых в программу
+/*!
+  Вызовы макросов SLX_LOG с уровнем ниже этого значения удаляются при компиляции.
+  0 - TRACE, 1 - DEBUG, 2 - INFO, 3 - WARN, 4 - ERROR, 5 - FATAL
+*/
+#ifndef SLX_LOG_MIN_LEVEL
+#define SLX_LOG_MIN_LEVEL 0
+#endif
+
+//! Залогировать сообщение с проверкой уровня до вычисления аргументов
+/*!
+  Если уровень ниже SLX_LOG_MIN_LEVEL, вызов не попадает в программу.
+  Иначе аргументы вычисляются, только если Logger::IsLevelEnabled вернул true.
+  Аргументы после уровня передаются в Logger::Log.
+  Место вызова записывается в статическую константу SourceLocation и передается в событие указателем.
+  Уровень проверяется в if constexpr, поэтому должен быть константным выражением.
+  Для уровня, известного только во время выполнения, используется SLX_LOG_RUNTIME.
+*/
+#define SLX_LOG(logger, level, ...) \
+  do \
+  { \
+    if constexpr (static_cast<int>(level) >= SLX_LOG_MIN_LEVEL) \
+    { \
+      if ((logger).IsLevelEnabled(level) == true) \
+      { \
+        static constexpr ::slx::SourceLocation slx_log_location{__FILE__, __func__, __LINE__}; \
+        (logger).Log(&slx_log_location, (level), __VA_ARGS__); \
+      } \
+    } \
+  } while (false)
+
+//! Залогировать сообщение с уровнем, вычисляемым во время выполнения
+/*!
+  Работает как SLX_LOG, но уровень сравнивается с SLX_LOG_MIN_LEVEL во время выполнения,
+  поэтому вызов не удаляется при компиляции. Уровень вычисляется один раз.
+*/
+#define SLX_LOG_RUNTIME(logger, level, ...) \
+  do \
+  { \
+    const ::slx::LoggerEvent::Level slx_log_level = (level); \
+    if (static_cast<int>(slx_log_level) >= SLX_LOG_MIN_LEVEL && (logger).IsLevelEnabled(slx_log_level) == true) \
+    { \
+      static constexpr ::slx::SourceLocation slx_log_location{__FILE__, __func__, __LINE__}; \
+      (logger).Log(&slx_log_location, slx_log_level, __VA_ARGS__); \
+    } \
+  } while (false)
+
+#define SLX_LOG_TRACE(logger, ...) SLX_LOG(logger, ::slx::LoggerEvent::Level::TRACE, __VA_ARGS__)
+#define SLX_LOG_DEBUG(logger, ...) SLX_LOG(logger, ::slx::LoggerEvent::Level::DEBUG, __VA_ARGS__)
+#define SLX_LOG_INFO(logger, ...)  SLX_LOG(logger, ::slx::LoggerEvent::Level::INFO, __VA_ARGS__)
+#define SLX_LOG_WARN(logger, ...)  SLX_LOG(logger, ::slx::LoggerEvent::Level::WARN, __VA_ARGS__)
+#define SLX_LOG_ERROR(logger, ...) SLX_LOG(logger, ::slx::LoggerEvent::Level::ERROR, __VA_ARGS__)
+#define SLX_LOG_FATAL(logger, ...) SLX_LOG(logger, ::slx::LoggerEvent::Level::FATAL, __VA_ARGS__)
+
 #endif //LOGGER_H
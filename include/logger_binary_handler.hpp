@@ -0,0 +1,175 @@
+#ifndef LOGLIB_LOGGER_BINARY_HANDLER_HPP
+#define LOGLIB_LOGGER_BINARY_HANDLER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include "logger.hpp"
+
+namespace slx
+{
+  //! Двоичный формат файла журнала
+  /*!
+    Файл начинается с сигнатуры MAGIC, за которой следуют записи. Первый байт записи - ее тип.
+    Целые числа записываются в формате varint (по 7 бит в байте, начиная с младших),
+    знаковые разности - после zigzag-преобразования.
+    Запись SESSION открывает сеанс записи: сбрасывает номера форматов, мест вызова и базу разностей.
+    Запись FORMAT: номер, длина, строка формата без завершающего нуля.
+    Запись LOCATION: номер, строка, длина и имя файла, длина и имя функции.
+    Запись EVENT: тип RECORD_EVENT + уровень, разность времени в наносекундах и порядкового номера
+    с предыдущим событием сеанса, номер формата, номер места вызова (только если в типе установлен
+    EVENT_HAS_LOCATION), размер данных, размер полей, данные, поля.
+    Если номер формата NO_FORMAT, данные - текст события, иначе аргументы в формате EncodeFormatArgs.
+    Поля записываются в формате EncodeFields. Значения аргументов записываются в порядке байт записывающей машины.
+  */
+  namespace binary_log
+  {
+    //! Сигнатура файла
+    const char MAGIC[8] = {'S', 'L', 'X', 'B', 'L', 'O', 'G', '1'};
+
+    //! Типы записей
+    enum RecordType : std::uint8_t
+    {
+      RECORD_SESSION = 'S'
+      , RECORD_FORMAT = 'F'
+      , RECORD_LOCATION = 'L'
+      , RECORD_EVENT = 0x80 //! Младшие биты содержат уровень события
+    };
+
+    //! Флаг записи EVENT: событие содержит номер места вызова
+    const std::uint8_t EVENT_HAS_LOCATION = 0x40;
+
+    //! Номер формата события без отложенного форматирования
+    const std::uint64_t NO_FORMAT = 0;
+  }
+
+  //! Обработчик, записывающий события в двоичном формате
+  /*!
+    Текст событий с отложенным форматированием не формируется: записываются только номер строки формата
+    и аргументы в двоичном виде. Каждая строка формата и каждое место вызова записываются в файл один раз
+    при первом использовании, события содержат только их номера.
+    Файл преобразуется в текст утилитой logdecode или классом BinaryLogReader.
+  */
+  class HandlerBinaryFile : public HandlerInterface
+  {
+  public:
+    //! Конструктор
+    /*!
+      Открывает файл на дозапись. В пустой файл записывается сигнатура, затем запись SESSION.
+      \param i_filename Имя файла
+    */
+    explicit HandlerBinaryFile(const std::string & i_filename);
+
+    ~HandlerBinaryFile() override = default;
+
+    //! Проверить, открыт ли файл
+    bool IsOpen() const;
+
+    bool IsRenderRequired() const override;
+
+  protected:
+    int HandlerFunction(const LoggerEvent &i_event) override;
+
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
+    //! Добавить событие в буфер, при первом использовании формата и места вызова добавить записи FORMAT и LOCATION
+    void AppendEvent(const LoggerEvent &i_event);
+
+    std::ofstream file;
+
+    //! Буфер, в который записывается пачка событий
+    std::string buffer;
+
+    //! Номера строк формата, уже записанных в файл
+    /*!
+      Строки формата - строковые литералы, поэтому ключом служит указатель
+    */
+    std::unordered_map<const char *, std::uint64_t> format_ids;
+    //! Номер следующей строки формата
+    std::uint64_t next_format_id;
+
+    //! Номера мест вызова, уже записанных в файл
+    std::unordered_map<const SourceLocation *, std::uint64_t> location_ids;
+    //! Номер следующего места вызова
+    std::uint64_t next_location_id;
+
+    //! Время и порядковый номер предыдущего записанного события
+    std::int64_t last_time_ns;
+    std::uint64_t last_sequence;
+  };
+
+  //! Чтение файлов, записанных HandlerBinaryFile
+  class BinaryLogReader
+  {
+  public:
+    //! Конструктор
+    /*!
+      Открывает файл и проверяет сигнатуру.
+      \param i_filename Имя файла
+    */
+    explicit BinaryLogReader(const std::string & i_filename);
+
+    //! Проверить, открыт ли файл и верна ли сигнатура
+    bool IsOpen() const;
+
+    //! Прочитать следующее событие
+    /*!
+      Текст события формируется из строки формата и аргументов. Поле format результата равно nullptr.
+      Поле location указывает на описание, которое хранится, пока существует BinaryLogReader.
+      \param o_event Событие
+      \return true Событие прочитано
+      \return false Конец файла или файл поврежден
+    */
+    bool ReadEvent(LoggerEvent &o_event);
+
+    //! Проверить, завершилось ли чтение из-за повреждения файла
+    /*!
+      \return true Файл поврежден или обрезан
+    */
+    bool IsCorrupted() const;
+
+  private:
+    //! Место вызова, прочитанное из записи LOCATION
+    struct LocationRecord
+    {
+      std::string file;
+      std::string function;
+      SourceLocation location;
+    };
+
+    //! Прочитать данные из файла
+    bool Read(void *o_data, std::size_t i_size);
+
+    //! Прочитать строку с длиной в формате varint
+    bool ReadString(std::string &o_string);
+
+    //! Прочитать число в формате varint
+    bool ReadVarint(std::uint64_t &o_value);
+
+    std::ifstream file;
+    bool valid;
+    bool corrupted;
+
+    //! Строки формата текущего сеанса по номерам
+    std::unordered_map<std::uint64_t, std::string> formats;
+
+    //! Места вызова текущего сеанса по номерам
+    std::unordered_map<std::uint64_t, const SourceLocation *> locations;
+    //! Все прочитанные места вызова. Не очищается при смене сеанса, на записи указывают прочитанные события
+    std::deque<LocationRecord> location_records;
+
+    //! Время и порядковый номер предыдущего события сеанса
+    std::int64_t last_time_ns;
+    std::uint64_t last_sequence;
+
+    //! Буфер для чтения данных события
+    std::string payload;
+  };
+}
+
+#endif //LOGLIB_LOGGER_BINARY_HANDLER_HPP
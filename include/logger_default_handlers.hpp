@@ -2,11 +2,87 @@
 #define LOGLIB_LOGGER_DEFAULT_HANDLERS_HPP
 
 #include <fstream>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "logger.hpp"
 
 namespace slx
 {
+  //! Номера форматов строк событий в кеше LoggerEvent::render_cache. 0 не используется
+  const std::uint16_t LINE_LAYOUT_DEFAULT = 1;
+  const std::uint16_t LINE_LAYOUT_DEFAULT_LEFT_ALIGN = 2;
+  const std::uint16_t LINE_LAYOUT_JSON = 3;
+  //! Первый номер формата, доступный пользовательским обработчикам
+  const std::uint16_t LINE_LAYOUT_USER = 256;
+
+  //! Добавить в буфер строку события, используя кеш строк события
+  /*!
+    Если строка формата i_layout уже сформирована другим обработчиком, копируются готовые байты.
+    Иначе строка формируется i_render и сохраняется в кеш, если кеш включен и в нем есть место.
+    Строка, сформированная i_render, должна зависеть только от события и i_layout.
+    \param o_buffer Буфер
+    \param i_event Событие
+    \param i_layout Номер формата строки, не 0
+    \param i_render Функция формирования строки, добавляет строку в переданный std::string &
+  */
+  template <typename Render>
+  void AppendCachedLine(std::string & o_buffer, const LoggerEvent & i_event, std::uint16_t i_layout, Render && i_render)
+  {
+    LoggerEvent::RenderCache & cache = i_event.render_cache;
+    if (cache.enabled == false)
+    {
+      i_render(o_buffer);
+      return;
+    }
+
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < LoggerEvent::RenderCache::SLOTS; ++i)
+    {
+      if (cache.layouts[i] == i_layout)
+      {
+        o_buffer.append(cache.text, begin, cache.ends[i] - begin);
+        return;
+      }
+
+      if (cache.layouts[i] == 0)
+      {
+        i_render(cache.text);
+        cache.layouts[i] = i_layout;
+        cache.ends[i] = static_cast<std::uint32_t>(cache.text.size());
+        o_buffer.append(cache.text, begin, cache.text.size() - begin);
+        return;
+      }
+
+      begin = cache.ends[i];
+    }
+
+    // Все ячейки заняты другими форматами
+    i_render(o_buffer);
+  }
+
+  //! Добавить в буфер строку события в формате обработчиков по умолчанию
+  /*!
+    Формат строки: "%Y-%m-%d %H:%M:%S LEVEL : data\n". Строка берется из кеша события, если уже сформирована
+    \param o_buffer Буфер
+    \param i_event Событие
+    \param i_left_align Выравнивать название уровня по левому краю
+  */
+  void AppendDefaultLine(std::string & o_buffer, const LoggerEvent & i_event, bool i_left_align = false);
+
+  //! Добавить в буфер событие в виде одной строки JSON
+  /*!
+    Формат строки: {"time":"%Y-%m-%dT%H:%M:%S.%9N","seq":N,"level":"LEVEL","message":"data",поля события}\n.
+    Если место вызова известно, после "message" добавляются "file", "line" и "function".
+    Строка берется из кеша события, если уже сформирована
+    \param o_buffer Буфер
+    \param i_event Событие
+  */
+  void AppendJsonLine(std::string & o_buffer, const LoggerEvent & i_event);
+
   class HandlerFilename : public HandlerInterface
   {
   public:
@@ -17,7 +93,14 @@ namespace slx
   protected:
     int HandlerFunction(const LoggerEvent &i_event) override;
 
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
     std::fstream file;
+
+    //! Буфер, в который форматируется пачка событий
+    std::string buffer;
   };
 
   class HandlerStream : public HandlerInterface
@@ -25,12 +108,19 @@ namespace slx
   public:
     explicit HandlerStream(std::ostream & i_stream);
 
-    ~HandlerStream() override = default;
+    ~HandlerStream() override;
 
   protected:
     int HandlerFunction(const LoggerEvent &i_event) override;
 
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
     std::ostream & out;
+
+    //! Буфер, в который форматируется пачка событий
+    std::string buffer;
   };
 
   class HandlerFILE : public HandlerInterface
@@ -38,12 +128,239 @@ namespace slx
   public:
     explicit HandlerFILE(FILE * i_file);
 
-    ~HandlerFILE() override = default;
+    ~HandlerFILE() override;
 
   protected:
     int HandlerFunction(const LoggerEvent &i_event) override;
 
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
     FILE * file;
+
+    //! Буфер, в который форматируется пачка событий
+    std::string buffer;
+  };
+
+  //! Обработчик, записывающий события в файл в формате JSON Lines
+  /*!
+    Каждое событие записывается отдельной строкой JSON, поля структурированных событий становятся членами объекта.
+  */
+  class HandlerJsonFile : public HandlerInterface
+  {
+  public:
+    explicit HandlerJsonFile(const std::string & i_filename);
+
+    ~HandlerJsonFile() override = default;
+
+  protected:
+    int HandlerFunction(const LoggerEvent &i_event) override;
+
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
+    std::fstream file;
+
+    //! Буфер, в который форматируется пачка событий
+    std::string buffer;
+  };
+
+  //! Обработчик, записывающий события в файл через отображение в память
+  /*!
+    Файл расширяется сегментами фиксированного размера (posix_fallocate), текущий сегмент отображается в память.
+    Строки копируются в отображение без системных вызовов, при заполнении сегмента отображается следующий.
+    Сброс (msync) выполняется по политике сброса обработчика, по умолчанию раз в секунду и после событий уровня ERROR.
+    При закрытии файл обрезается до фактического конца данных. После аварийного завершения в конце файла
+    могут остаться нулевые байты неиспользованной части сегмента.
+  */
+  class HandlerMmapFile : public HandlerInterface
+  {
+  public:
+    //! Размер сегмента по умолчанию
+    static const std::size_t DEFAULT_SEGMENT_SIZE = 16 * 1024 * 1024;
+
+    //! Конструктор
+    /*!
+      Открывает файл на дозапись.
+      \param i_filename Имя файла
+      \param i_segment_size Размер сегмента. Округляется вверх до размера страницы
+    */
+    explicit HandlerMmapFile(const std::string & i_filename, std::size_t i_segment_size = DEFAULT_SEGMENT_SIZE);
+
+    ~HandlerMmapFile() override;
+
+    //! Проверить, открыт ли файл
+    /*!
+      \return true файл открыт и отображен в память
+    */
+    bool IsOpen() const;
+
+    //! Закрыть файл
+    /*!
+      Сбрасывает данные на диск и отрезает неиспользованную часть последнего сегмента.
+      После закрытия события не записываются. Вызывается из деструктора, если не была вызвана раньше.
+      \return 0 Успех
+      \return 1 Не удалось отрезать неиспользованную часть сегмента, в конце файла остались нулевые байты
+    */
+    int Close();
+
+  protected:
+    int HandlerFunction(const LoggerEvent &i_event) override;
+
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
+    //! Отобразить сегмент файла, начинающийся со смещения i_offset
+    /*!
+      \param i_offset Смещение сегмента в файле, кратное размеру страницы
+      \return true Успех
+    */
+    bool MapSegment(std::size_t i_offset);
+
+    //! Скопировать данные в отображение, при необходимости переходя к следующему сегменту
+    /*!
+      \return true Успех
+    */
+    bool Write(const char *i_data, std::size_t i_size);
+
+    //! Файловый дескриптор
+    int fd;
+    //! Размер сегмента
+    std::size_t segment_size;
+    //! Отображение текущего сегмента
+    char * mapping;
+    //! Смещение текущего сегмента в файле
+    std::size_t segment_offset;
+    //! Конец записанных данных внутри текущего сегмента
+    std::size_t tail;
+    //! Начало данных, не сброшенных msync, внутри текущего сегмента
+    std::size_t synced;
+
+    //! Буфер, в который форматируется пачка событий
+    std::string buffer;
+  };
+
+  //! Обработчик, записывающий события в файл с ротацией по размеру и по времени
+  /*!
+    Текущий файл всегда имеет имя filename. При ротации он закрывается и переименовывается во временное имя,
+    после чего сразу открывается новый файл. Сдвиг поколений (filename.1, filename.2, ...) и сжатие
+    выполняются отдельным фоновым потоком, поэтому поток обработки событий не ждет их завершения.
+    Хранится не больше generations закрытых файлов, самый новый имеет номер 1.
+    Если сжать файл не удалось, поколение хранится без сжатия (filename.N вместо filename.N.gz).
+    Если переименовать текущий файл не удалось, следующая попытка ротации выполняется
+    не раньше чем через ROTATION_RETRY_INTERVAL, до этого события дописываются в текущий файл.
+  */
+  class HandlerRotatingFile : public HandlerInterface
+  {
+  public:
+    //! Период повторных попыток ротации после ошибки переименования файла
+    static constexpr std::chrono::seconds ROTATION_RETRY_INTERVAL = std::chrono::seconds(10);
+
+    //! Сжатие закрытых файлов
+    enum class Compression
+    {
+      NONE = 0 //! Без сжатия
+      , GZIP   //! gzip (zlib). Если библиотека недоступна при сборке, файлы не сжимаются
+    };
+
+    //! Параметры ротации
+    struct RotationPolicy
+    {
+      //! Максимальный размер файла в байтах. 0 - не учитывать размер
+      std::size_t max_size = 100 * 1024 * 1024;
+      //! Период ротации, отсчитывается от начала эпохи (например, ровно каждый час). 0 - не учитывать время
+      std::chrono::seconds interval = std::chrono::seconds(0);
+      //! Количество хранимых закрытых файлов
+      std::size_t generations = 5;
+      //! Сжатие закрытых файлов
+      Compression compression = Compression::GZIP;
+    };
+
+    //! Конструктор
+    /*!
+      Открывает файл на дозапись и запускает фоновый поток обслуживания закрытых файлов.
+      \param i_filename Имя файла
+      \param i_policy Параметры ротации
+    */
+    HandlerRotatingFile(const std::string & i_filename, const RotationPolicy & i_policy);
+
+    //! Деструктор
+    /*!
+      Закрывает файл и ожидает, пока фоновый поток обработает все закрытые файлы.
+    */
+    ~HandlerRotatingFile() override;
+
+    //! Проверить, доступно ли сжатие gzip
+    /*!
+      \return true библиотека zlib была доступна при сборке
+    */
+    static bool IsCompressionAvailable();
+
+  protected:
+    int HandlerFunction(const LoggerEvent &i_event) override;
+
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
+    //! Открыть текущий файл и рассчитать время следующей ротации
+    void OpenFile();
+
+    //! Закрыть текущий файл, передать его фоновому потоку и открыть новый
+    void Rotate();
+
+    //! Проверить, нужна ли ротация перед записью i_size байт
+    /*!
+      \param i_size Размер данных буфера, еще не записанных в файл
+      \param i_line_size Размер последней строки буфера. Пустой файл не ротируется, если буфер содержит
+      только эту строку, даже если она больше max_size
+    */
+    bool RotationRequired(std::size_t i_size, std::size_t i_line_size) const;
+
+    //! Записать буфер в текущий файл
+    void WriteBuffer();
+
+    //! Функция фонового потока
+    /*!
+      Сдвигает поколения закрытых файлов, удаляет лишние и сжимает самый новый.
+      \param d_handler Указатель на собственный объект класса
+    */
+    static void ArchiveWorker(HandlerRotatingFile *d_handler);
+
+    //! Переместить закрытый файл в первое поколение
+    void Archive(const std::string &i_pending);
+
+    //! Имя файла поколения i_generation
+    /*!
+      \param i_compressed true - имя сжатого файла
+    */
+    std::string GenerationName(std::size_t i_generation, bool i_compressed) const;
+
+    std::string filename;
+    RotationPolicy policy;
+
+    std::fstream file;
+    //! Размер текущего файла
+    std::size_t file_size;
+    //! Время следующей ротации по времени
+    std::chrono::system_clock::time_point next_rotation;
+    //! Счетчик для уникальных временных имен закрытых файлов
+    std::size_t rotation_counter;
+    //! Время, до которого ротация не выполняется после ошибки переименования
+    std::chrono::steady_clock::time_point rotation_retry;
+
+    //! Буфер, в который форматируется пачка событий
+    std::string buffer;
+
+    //! Закрытые файлы, ожидающие обработки фоновым потоком
+    std::deque<std::string> pending;
+    std::mutex pending_mtx;
+    std::condition_variable pending_cv;
+    bool archive_active;
+    std::thread archive_thread;
   };
 }
 
@@ -0,0 +1,414 @@
+#ifndef LOGLIB_LOGGER_FORMAT_HPP
+#define LOGLIB_LOGGER_FORMAT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace slx
+{
+  class EventData;
+
+  //! Типы аргументов отложенного форматирования в двоичном представлении
+  enum class FormatArgType : std::uint8_t
+  {
+    INT = 0   //! Знаковое целое, std::int64_t
+    , UINT    //! Беззнаковое целое, std::uint64_t
+    , DOUBLE  //! Число с плавающей точкой, double
+    , POINTER //! Указатель, std::uintptr_t
+    , STRING  //! Строка, std::uint32_t длина и символы без завершающего нуля
+    , BOOL    //! Логическое значение, std::uint8_t. Используется только в полях событий
+    , INT32   //! Знаковое целое разрядностью до 32 бит, std::int32_t
+    , UINT32  //! Беззнаковое целое разрядностью до 32 бит, std::uint32_t
+  };
+
+  namespace format_detail
+  {
+    //! Категории аргументов для проверки строки формата
+    enum class ArgCategory
+    {
+      NONE = 0
+      , INTEGER
+      , FLOATING
+      , STRING
+      , POINTER
+    };
+
+    template<typename T>
+    constexpr ArgCategory CategoryOf()
+    {
+      using D = std::remove_cv_t<std::remove_reference_t<T>>;
+      using P = std::decay_t<D>;
+
+      if constexpr (std::is_integral_v<D>)
+      {
+        return ArgCategory::INTEGER;
+      }
+      else if constexpr (std::is_floating_point_v<D>)
+      {
+        return ArgCategory::FLOATING;
+      }
+      else if constexpr (std::is_same_v<P, const char *> || std::is_same_v<P, char *>
+                         || std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>)
+      {
+        return ArgCategory::STRING;
+      }
+      else if constexpr (std::is_pointer_v<P> || std::is_null_pointer_v<D>)
+      {
+        return ArgCategory::POINTER;
+      }
+      else
+      {
+        return ArgCategory::NONE;
+      }
+    }
+
+    //! Вызывается при ошибке в строке формата. Не является constexpr, поэтому вызов во время компиляции дает ошибку
+    void FormatStringError(const char *i_reason);
+
+    constexpr bool IsFlag(char i_ch)
+    {
+      return i_ch == '-' || i_ch == '+' || i_ch == ' ' || i_ch == '#' || i_ch == '0';
+    }
+
+    constexpr bool IsDigit(char i_ch)
+    {
+      return i_ch >= '0' && i_ch <= '9';
+    }
+
+    constexpr bool IsLengthModifier(char i_ch)
+    {
+      return i_ch == 'h' || i_ch == 'l' || i_ch == 'j' || i_ch == 'z' || i_ch == 't' || i_ch == 'L' || i_ch == 'q';
+    }
+
+    constexpr bool ConversionMatches(char i_conv, ArgCategory i_category)
+    {
+      switch (i_category)
+      {
+        case ArgCategory::INTEGER:
+          return i_conv == 'd' || i_conv == 'i' || i_conv == 'u' || i_conv == 'o'
+                 || i_conv == 'x' || i_conv == 'X' || i_conv == 'c';
+        case ArgCategory::FLOATING:
+          return i_conv == 'f' || i_conv == 'F' || i_conv == 'e' || i_conv == 'E'
+                 || i_conv == 'g' || i_conv == 'G' || i_conv == 'a' || i_conv == 'A';
+        case ArgCategory::STRING:
+          return i_conv == 's';
+        case ArgCategory::POINTER:
+          return i_conv == 'p';
+        default:
+          return false;
+      }
+    }
+
+    //! Проверить строку формата printf на соответствие типам аргументов
+    /*!
+      Поддерживаются флаги, ширина, точность и модификаторы длины. Ширина и точность '*' не поддерживаются.
+      \param i_fmt Строка формата
+      \param i_categories Категории аргументов
+      \param i_count Количество аргументов
+    */
+    constexpr void CheckFormat(const char *i_fmt, const ArgCategory *i_categories, std::size_t i_count)
+    {
+      std::size_t arg = 0;
+      for (const char * p = i_fmt; *p != '\0'; ++p)
+      {
+        if (*p != '%')
+        {
+          continue;
+        }
+
+        ++p;
+        if (*p == '%')
+        {
+          continue;
+        }
+
+        while (IsFlag(*p))
+        {
+          ++p;
+        }
+        while (IsDigit(*p))
+        {
+          ++p;
+        }
+        if (*p == '.')
+        {
+          ++p;
+          while (IsDigit(*p))
+          {
+            ++p;
+          }
+        }
+        if (*p == '*')
+        {
+          FormatStringError("'*' width and precision are not supported");
+        }
+        while (IsLengthModifier(*p))
+        {
+          ++p;
+        }
+
+        if (*p == '\0')
+        {
+          FormatStringError("incomplete conversion specification");
+        }
+        if (arg >= i_count)
+        {
+          FormatStringError("not enough arguments for format string");
+        }
+        if (ConversionMatches(*p, i_categories[arg]) == false)
+        {
+          FormatStringError("argument type does not match conversion specifier");
+        }
+        ++arg;
+      }
+
+      if (arg != i_count)
+      {
+        FormatStringError("too many arguments for format string");
+      }
+    }
+
+    template<typename Buffer, typename V>
+    void EncodeValue(Buffer & o_buffer, FormatArgType i_type, V i_value)
+    {
+      char bytes[1 + sizeof(V)];
+      bytes[0] = static_cast<char>(i_type);
+      std::memcpy(bytes + 1, &i_value, sizeof(V));
+      o_buffer.append(bytes, sizeof(bytes));
+    }
+
+    template<typename Buffer>
+    void EncodeString(Buffer & o_buffer, const char *i_data, std::size_t i_size)
+    {
+      if (i_data == nullptr)
+      {
+        i_data = "(null)";
+        i_size = 6;
+      }
+
+      std::uint32_t size = static_cast<std::uint32_t>(i_size);
+      EncodeValue(o_buffer, FormatArgType::STRING, size);
+      o_buffer.append(i_data, size);
+    }
+
+    template<typename Buffer, typename T>
+    void EncodeArg(Buffer & o_buffer, const T & i_arg)
+    {
+      using D = std::decay_t<T>;
+
+      // Разрядность целого сохраняется, чтобы %x и %u выводили значение так же, как printf
+      if constexpr (std::is_integral_v<D> && std::is_signed_v<D> && sizeof(D) <= sizeof(std::int32_t))
+      {
+        EncodeValue(o_buffer, FormatArgType::INT32, static_cast<std::int32_t>(i_arg));
+      }
+      else if constexpr (std::is_integral_v<D> && std::is_signed_v<D>)
+      {
+        EncodeValue(o_buffer, FormatArgType::INT, static_cast<std::int64_t>(i_arg));
+      }
+      else if constexpr (std::is_integral_v<D> && sizeof(D) <= sizeof(std::uint32_t))
+      {
+        EncodeValue(o_buffer, FormatArgType::UINT32, static_cast<std::uint32_t>(i_arg));
+      }
+      else if constexpr (std::is_integral_v<D>)
+      {
+        EncodeValue(o_buffer, FormatArgType::UINT, static_cast<std::uint64_t>(i_arg));
+      }
+      else if constexpr (std::is_floating_point_v<D>)
+      {
+        EncodeValue(o_buffer, FormatArgType::DOUBLE, static_cast<double>(i_arg));
+      }
+      else if constexpr (std::is_same_v<D, const char *> || std::is_same_v<D, char *>)
+      {
+        const char * str = i_arg;
+        EncodeString(o_buffer, str, str == nullptr ? 0 : std::strlen(str));
+      }
+      else if constexpr (std::is_same_v<D, std::string> || std::is_same_v<D, std::string_view>)
+      {
+        EncodeString(o_buffer, i_arg.data(), i_arg.size());
+      }
+      else if constexpr (std::is_null_pointer_v<D>)
+      {
+        EncodeValue(o_buffer, FormatArgType::POINTER, std::uintptr_t(0));
+      }
+      else
+      {
+        EncodeValue(o_buffer, FormatArgType::POINTER, reinterpret_cast<std::uintptr_t>(i_arg));
+      }
+    }
+  }
+
+  namespace format_detail
+  {
+    template<typename Buffer, typename T>
+    void EncodeField(Buffer & o_buffer, const char *i_key, const T & i_value)
+    {
+      std::size_t key_size = std::min<std::size_t>(std::strlen(i_key), 255);
+      char size = static_cast<char>(key_size);
+      o_buffer.append(&size, 1);
+      o_buffer.append(i_key, key_size);
+
+      if constexpr (std::is_same_v<T, bool>)
+      {
+        EncodeValue(o_buffer, FormatArgType::BOOL, static_cast<std::uint8_t>(i_value));
+      }
+      else
+      {
+        EncodeArg(o_buffer, i_value);
+      }
+    }
+  }
+
+  //! Строка формата, проверяемая во время компиляции
+  /*!
+    Формат аналогичен printf. Количество спецификаторов и их типы сверяются с типами аргументов Args.
+    Объект может быть создан только из константного выражения, обычно из строкового литерала.
+    \tparam Args Типы аргументов
+  */
+  template<typename... Args>
+  class FormatString
+  {
+  public:
+    template<typename S, typename = std::enable_if_t<std::is_convertible_v<const S &, const char *>>>
+    consteval FormatString(const S & i_fmt)
+      : fmt(i_fmt)
+    {
+      constexpr format_detail::ArgCategory categories[sizeof...(Args) + 1] =
+        {format_detail::CategoryOf<Args>()..., format_detail::ArgCategory::NONE};
+      format_detail::CheckFormat(fmt, categories, sizeof...(Args));
+    }
+
+    //! Получить строку формата
+    constexpr const char * Get() const
+    {
+      return fmt;
+    }
+
+  private:
+    const char * fmt;
+  };
+
+  //! Поле структурированного события
+  /*!
+    Создается функцией Field на месте вызова. Значение хранится копией, в том числе std::string,
+    поэтому поле можно сохранить и использовать после удаления исходного значения.
+    Для строк C и std::string_view копируется только указатель на данные.
+    \tparam T Тип значения
+  */
+  template<typename T>
+  struct LogField
+  {
+    //! Тип хранимого значения
+    using ValueType = std::decay_t<const T>;
+
+    //! Имя поля. Длина не больше 255 символов
+    const char * key;
+    //! Значение поля
+    ValueType value;
+  };
+
+  //! Создать поле структурированного события
+  /*!
+    \param i_key Имя поля
+    \param i_value Значение: целое, логическое, с плавающей точкой, строка или указатель
+    \return поле
+  */
+  template<typename T>
+  LogField<T> Field(const char *i_key, const T &i_value)
+  {
+    static_assert(format_detail::CategoryOf<T>() != format_detail::ArgCategory::NONE,
+                  "unsupported field value type");
+    return LogField<T>{i_key, i_value};
+  }
+
+  //! Поле структурированного события, прочитанное из двоичного представления
+  struct FieldValue
+  {
+    //! Имя поля
+    std::string_view key;
+    //! Тип значения. Целые INT32 и UINT32 читаются как INT и UINT
+    FormatArgType type = FormatArgType::INT;
+    //! Значение типов INT, UINT, POINTER и BOOL
+    std::uint64_t integer = 0;
+    //! Значение типа DOUBLE
+    double floating = 0;
+    //! Значение типа STRING
+    std::string_view string;
+  };
+
+  //! Записать поля структурированного события в двоичном представлении
+  /*!
+    Каждое поле записывается как std::uint8_t длина имени, имя и значение в формате аргументов отложенного форматирования.
+    \param o_buffer Буфер с методом append(const char *, std::size_t)
+    \param i_fields Поля
+  */
+  template<typename Buffer, typename... T>
+  void EncodeFields(Buffer & o_buffer, const LogField<T> &... i_fields)
+  {
+    (format_detail::EncodeField(o_buffer, i_fields.key, i_fields.value), ...);
+  }
+
+  //! Прочитать следующее поле из двоичного представления
+  /*!
+    \param io_pos Позиция чтения. Сдвигается за прочитанное поле
+    \param i_end Конец данных
+    \param o_field Поле. Строковые значения ссылаются на исходные данные
+    \return true Поле прочитано
+    \return false Данные закончились или повреждены
+  */
+  bool ReadField(const char *&io_pos, const char *i_end, FieldValue &o_field);
+
+  //! Добавить поля в текстовом виде " key=value key=value"
+  /*!
+    Строки, содержащие пробелы, кавычки, '=', табуляцию или перевод строки, заключаются в кавычки,
+    кавычки и '\\' внутри них экранируются, перевод строки, возврат каретки и табуляция выводятся как \\n, \\r, \\t.
+    \param o_buffer Результат. Текст добавляется в конец
+    \param i_fields Поля, записанные EncodeFields
+    \param i_size Размер полей в байтах
+  */
+  void RenderFieldsText(std::string &o_buffer, const char *i_fields, std::size_t i_size);
+
+  //! Добавить поля в виде членов объекта JSON ,"key":value,"key":value
+  /*!
+    Имена, совпадающие со стандартными членами строки JSON (time, seq, level, message, file, line, function),
+    выводятся с префиксом "field_", чтобы объект не содержал повторяющихся членов.
+    \param o_buffer Результат. Текст добавляется в конец
+    \param i_fields Поля, записанные EncodeFields
+    \param i_size Размер полей в байтах
+  */
+  void RenderFieldsJson(std::string &o_buffer, const char *i_fields, std::size_t i_size);
+
+  //! Добавить строку JSON в кавычках с экранированием
+  /*!
+    \param o_buffer Результат. Текст добавляется в конец
+    \param i_data Строка
+    \param i_size Длина строки
+  */
+  void AppendJsonString(std::string &o_buffer, const char *i_data, std::size_t i_size);
+
+  //! Записать аргументы в двоичном представлении
+  /*!
+    \param o_buffer Буфер с методом append(const char *, std::size_t)
+    \param i_args Аргументы
+  */
+  template<typename Buffer, typename... Args>
+  void EncodeFormatArgs(Buffer & o_buffer, const Args &... i_args)
+  {
+    (format_detail::EncodeArg(o_buffer, i_args), ...);
+  }
+
+  //! Отформатировать сообщение по строке формата и аргументам в двоичном представлении
+  /*!
+    \param i_fmt Строка формата
+    \param i_args Аргументы, записанные EncodeFormatArgs
+    \param i_args_size Размер аргументов в байтах
+    \param o_data Результат. Форматированный текст добавляется в конец
+  */
+  void RenderFormat(const char *i_fmt, const char *i_args, std::size_t i_args_size, EventData &o_data);
+}
+
+#endif //LOGLIB_LOGGER_FORMAT_HPP
@@ -0,0 +1,91 @@
+#ifndef LOGLIB_LOGGER_JOURNAL_HPP
+#define LOGLIB_LOGGER_JOURNAL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace slx
+{
+  struct LoggerEvent;
+
+  //! Журнал необработанных событий асинхронной очереди в файле, отображенном в память
+  /*!
+    Каждое событие, помещаемое в очередь, копируется в ячейку кольца с номером sequence % емкость
+    и помечается как ожидающее. Поток обработки после передачи события обработчикам снимает пометку.
+    Отображение разделяемое (MAP_SHARED), поэтому записанные данные остаются в страничном кэше
+    при аварийном завершении процесса, обработчик сигналов для этого не нужен.
+    При следующем запуске ожидающие события читаются из файла и передаются обработчикам.
+    Сохранность при сбое всей системы не гарантируется, msync не выполняется.
+    Данные события, не поместившиеся в ячейку, обрезаются.
+  */
+  class EventJournal
+  {
+  public:
+    //! Размер ячейки кольца
+    static const std::size_t SLOT_SIZE = 256;
+
+    EventJournal();
+
+    ~EventJournal();
+
+    EventJournal(const EventJournal &) = delete;
+
+    EventJournal & operator=(const EventJournal &) = delete;
+
+    //! Открыть журнал
+    /*!
+      Если файл содержит журнал, ожидающие события читаются из него. Затем журнал очищается.
+      Непустой файл без сигнатуры журнала не изменяется, журнал в этом случае не открывается.
+      \param i_filename Имя файла
+      \param i_capacity Количество ячеек. Округляется вверх до степени двойки.
+                        Должно быть не меньше емкости очереди, иначе необработанные события могут быть перезаписаны
+      \param o_recovered События, не обработанные в предыдущем запуске, в порядке порядковых номеров.
+                         Текст событий сформирован, format равен nullptr
+      \return true Успех
+      \return false Файл не удалось открыть или он непустой и не содержит сигнатуры журнала
+    */
+    bool Open(const std::string &i_filename, std::size_t i_capacity, std::vector<LoggerEvent> &o_recovered);
+
+    //! Записать событие в ячейку и пометить его как ожидающее
+    /*!
+      Потокобезопасен для событий с разными порядковыми номерами.
+      \param i_event Событие с заполненными sequence, time_ns и level
+    */
+    void Write(const LoggerEvent &i_event);
+
+    //! Снять пометку ожидания с события
+    /*!
+      Если ячейка уже занята другим событием, ничего не делает.
+      \param i_sequence Порядковый номер события
+    */
+    void MarkDelivered(std::uint64_t i_sequence);
+
+  private:
+    struct Header;
+    struct Slot;
+
+    //! Отобразить файл и проверить заголовок
+    bool Map(std::size_t i_size);
+
+    //! Освободить отображение
+    void Unmap();
+
+    //! Прочитать ожидающие события
+    void Recover(std::vector<LoggerEvent> &o_recovered);
+
+    //! Создать пустой журнал
+    bool Init(std::size_t i_capacity);
+
+    int fd;
+    void * map;
+    std::size_t map_size;
+    Header * header;
+    Slot * slots;
+    std::size_t mask;
+  };
+}
+
+#endif //LOGLIB_LOGGER_JOURNAL_HPP
@@ -0,0 +1,118 @@
+#ifndef LOGLIB_LOGGER_LAYOUT_HPP
+#define LOGLIB_LOGGER_LAYOUT_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace slx
+{
+  //! Формат строки события, заданный шаблоном
+  /*!
+    Шаблон разбирается один раз при создании в список операций, при формировании строки
+    операции выполняются подряд без разбора шаблона и выделения памяти.
+    Спецификаторы шаблона:
+    - %d{формат} - время события, формат как у Logger::FormatTimestampNs (%3N или %ms, %6N или %us, %9N - доли секунды).
+      %d без фигурных скобок - "%Y-%m-%d %H:%M:%S"
+    - %l - название уровня
+    - %v - текст события
+    - %f - поля структурированного события " key=value", пусто, если полей нет
+    - %t - идентификатор потока, создавшего событие
+    - %i - порядковый номер события в логгере
+    - %n - имя логгера (Logger::SetName), пусто, если имя не задано
+    - %s - имя файла места вызова без каталогов, %g - имя файла как в __FILE__
+    - %# - номер строки места вызова, %! - имя функции, %@ - "файл:строка" (имя файла без каталогов)
+      Место вызова известно для событий, созданных макросами SLX_LOG, для остальных выводится пустая строка
+    - %% - символ '%'
+    Между '%' и спецификатором можно указать ширину поля: %5l - выравнивание по правому краю,
+    %-5l - по левому. Неизвестные спецификаторы выводятся как есть.
+    После шаблона в строку добавляется перевод строки.
+    Пример: "%d{%H:%M:%S.%us} [%t] %-5l %v%f"
+  */
+  class Layout
+  {
+  public:
+    //! Создать формат
+    /*!
+      \param i_pattern Шаблон строки
+    */
+    explicit Layout(const std::string & i_pattern);
+
+    Layout(const Layout &) = delete;
+
+    Layout & operator=(const Layout &) = delete;
+
+    //! Добавить в буфер строку события
+    /*!
+      Строка берется из кеша события, если уже сформирована форматом с таким же шаблоном.
+      \param o_buffer Буфер
+      \param i_event Событие
+    */
+    void Append(std::string & o_buffer, const LoggerEvent & i_event) const;
+
+    //! Получить шаблон
+    /*!
+      \return шаблон строки
+    */
+    const std::string & GetPattern() const;
+
+  private:
+    //! Операции формирования строки
+    enum class OpType : std::uint8_t
+    {
+      LITERAL = 0
+      , TIMESTAMP
+      , LEVEL
+      , MESSAGE
+      , FIELDS
+      , THREAD
+      , SEQUENCE
+      , LOGGER_NAME
+      , SOURCE_FILE
+      , SOURCE_PATH
+      , SOURCE_LINE
+      , SOURCE_FUNCTION
+      , SOURCE_FILE_LINE
+    };
+
+    struct Op
+    {
+      OpType type;
+      //! Выравнивание по левому краю
+      bool left_align;
+      //! Ширина поля. 0 - без выравнивания
+      std::uint16_t width;
+      //! Текст LITERAL или формат времени TIMESTAMP: смещение и длина в texts
+      std::uint32_t offset;
+      std::uint32_t size;
+    };
+
+    //! Разобрать шаблон в список операций
+    void Compile();
+
+    //! Добавить операцию вывода текста
+    void AddLiteral(const char * i_text, std::size_t i_size);
+
+    //! Получить длину результата операции без ее выполнения
+    /*!
+      \return длина. std::string::npos - длина заранее неизвестна
+    */
+    static std::size_t KnownLength(const Op & i_op, const LoggerEvent & i_event);
+
+    //! Сформировать строку события
+    void Render(std::string & o_buffer, const LoggerEvent & i_event) const;
+
+    //! Шаблон строки
+    std::string pattern;
+    //! Операции
+    std::vector<Op> ops;
+    //! Тексты операций. Форматы времени завершаются нулем
+    std::string texts;
+    //! Номер формата в кеше строк события. Одинаковые шаблоны получают одинаковый номер
+    std::uint16_t layout_id;
+  };
+}
+
+#endif //LOGLIB_LOGGER_LAYOUT_HPP
@@ -0,0 +1,196 @@
+#ifndef LOGLIB_LOGGER_RING_BUFFER_HPP
+#define LOGLIB_LOGGER_RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace slx
+{
+  //! Ограниченная lock-free очередь на кольцевом буфере
+  /*!
+    Много производителей, один основной потребитель (MPSC).
+    Все ячейки выделяются заранее при создании очереди. Каждая ячейка хранит счетчик sequence,
+    по которому производители и потребитель определяют, свободна ли ячейка (алгоритм Д. Вьюкова).
+    Производитель занимает ячейку одной операцией CAS над enqueue_pos, блокировки не используются.
+    Извлечение также выполняется через CAS, поэтому производитель может вытеснить самый старый элемент
+    при переполнении одновременно с работой потребителя.
+    \tparam T Тип элемента. Должен иметь конструктор по умолчанию и перемещающее присваивание
+  */
+  template<typename T>
+  class RingBuffer
+  {
+  public:
+    //! Конструктор
+    /*!
+      Емкость округляется вверх до степени двойки, но не меньше 2.
+      \param i_capacity Желаемая емкость очереди
+    */
+    explicit RingBuffer(std::size_t i_capacity)
+      : capacity(RoundCapacity(i_capacity))
+      , mask(capacity - 1)
+      , slots(new Slot[capacity])
+      , enqueue_pos(0)
+      , dequeue_pos(0)
+    {
+      for (std::size_t i = 0; i < capacity; ++i)
+      {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    RingBuffer(const RingBuffer &) = delete;
+
+    RingBuffer & operator=(const RingBuffer &) = delete;
+
+    //! Добавить элемент в очередь
+    /*!
+      Потокобезопасен для любого количества производителей.
+      Элемент перемещается в очередь только в случае успеха.
+      \param i_item Элемент
+      \param i_priority Приоритет элемента для TryPopBelow
+      \return true Элемент добавлен
+      \return false Очередь заполнена
+    */
+    bool TryPush(T && i_item, std::uint8_t i_priority = 0)
+    {
+      Slot * slot;
+      std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        slot = &slots[pos & mask];
+        std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0)
+        {
+          if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            break;
+          }
+        }
+        else if (diff < 0)
+        {
+          return false;
+        }
+        else
+        {
+          pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+      }
+
+      slot->item = std::move(i_item);
+      slot->priority.store(i_priority, std::memory_order_relaxed);
+      slot->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    //! Извлечь элемент из очереди
+    /*!
+      Потокобезопасен, может вызываться одновременно из нескольких потоков.
+      \param o_item Извлеченный элемент
+      \return true Элемент извлечен
+      \return false Очередь пуста
+    */
+    bool TryPop(T & o_item)
+    {
+      return TryPopBelow(o_item, UINT8_MAX + 1);
+    }
+
+    //! Извлечь самый старый элемент, если его приоритет ниже заданного
+    /*!
+      Потокобезопасен, может вызываться одновременно из нескольких потоков.
+      Элементы после самого старого не рассматриваются.
+      \param o_item Извлеченный элемент
+      \param i_priority Граница приоритета. Извлекается только элемент с приоритетом меньше i_priority
+      \return true Элемент извлечен
+      \return false Очередь пуста или приоритет самого старого элемента не ниже i_priority
+    */
+    bool TryPopBelow(T & o_item, unsigned i_priority)
+    {
+      Slot * slot;
+      std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        slot = &slots[pos & mask];
+        std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0)
+        {
+          if (slot->priority.load(std::memory_order_relaxed) >= i_priority)
+          {
+            return false;
+          }
+
+          if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          {
+            break;
+          }
+        }
+        else if (diff < 0)
+        {
+          return false;
+        }
+        else
+        {
+          pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+      }
+
+      o_item = std::move(slot->item);
+      slot->sequence.store(pos + capacity, std::memory_order_release);
+      return true;
+    }
+
+    //! Получить приблизительное количество элементов в очереди
+    /*!
+      \return количество элементов
+    */
+    std::size_t Size() const
+    {
+      std::size_t head = dequeue_pos.load(std::memory_order_relaxed);
+      std::size_t tail = enqueue_pos.load(std::memory_order_relaxed);
+      return tail > head ? tail - head : 0;
+    }
+
+    //! Получить емкость очереди
+    /*!
+      \return емкость очереди
+    */
+    std::size_t Capacity() const
+    {
+      return capacity;
+    }
+
+  private:
+    struct Slot
+    {
+      std::atomic<std::size_t> sequence;
+      //! Приоритет элемента. Атомарный, так как читается до захвата ячейки
+      std::atomic<std::uint8_t> priority{0};
+      T item;
+    };
+
+    static std::size_t RoundCapacity(std::size_t i_capacity)
+    {
+      std::size_t result = 2;
+      while (result < i_capacity)
+      {
+        result <<= 1;
+      }
+      return result;
+    }
+
+    const std::size_t capacity;
+    const std::size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    //! Позиция записи. Разделяется всеми производителями
+    alignas(64) std::atomic<std::size_t> enqueue_pos;
+    //! Позиция чтения
+    alignas(64) std::atomic<std::size_t> dequeue_pos;
+  };
+}
+
+#endif //LOGLIB_LOGGER_RING_BUFFER_HPP
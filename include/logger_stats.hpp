@@ -0,0 +1,119 @@
+#ifndef LOGLIB_LOGGER_STATS_HPP
+#define LOGLIB_LOGGER_STATS_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace slx
+{
+  //! Гистограмма длительностей с логарифмически-линейными интервалами
+  /*!
+    Значения меньше SUB_BUCKETS попадают в отдельные интервалы. Каждый следующий диапазон [2^k, 2^(k+1))
+    делится на SUB_BUCKETS равных интервалов, поэтому относительная погрешность не превышает 1 / SUB_BUCKETS.
+    Запись выполняется без блокировок и может вызываться из любого потока.
+    Счетчики не обнуляются, снимок содержит накопленные значения.
+  */
+  class LatencyHistogram
+  {
+  public:
+    //! log2 количества интервалов в каждом диапазоне степени двойки
+    static const unsigned SUB_BUCKET_BITS = 3;
+    //! Количество интервалов в каждом диапазоне степени двойки
+    static const std::size_t SUB_BUCKETS = std::size_t(1) << SUB_BUCKET_BITS;
+    //! Общее количество интервалов, покрывающее весь диапазон std::uint64_t
+    static const std::size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    //! Снимок гистограммы
+    struct Snapshot
+    {
+      //! Количество значений в интервалах. Границы интервала i - BucketLowerBound(i), BucketUpperBound(i)
+      std::vector<std::uint64_t> buckets;
+      //! Количество значений
+      std::uint64_t count = 0;
+      //! Сумма значений
+      std::uint64_t sum = 0;
+      //! Максимальное значение
+      std::uint64_t max = 0;
+
+      //! Получить оценку квантиля
+      /*!
+        \param i_quantile Квантиль от 0 до 1, например 0.99
+        \return Верхняя граница интервала, содержащего квантиль, но не больше max. 0 если значений нет
+      */
+      std::uint64_t Percentile(double i_quantile) const;
+
+      //! Получить среднее значение
+      /*!
+        \return Среднее значение. 0 если значений нет
+      */
+      double Mean() const;
+    };
+
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram &) = delete;
+
+    LatencyHistogram & operator=(const LatencyHistogram &) = delete;
+
+    //! Записать значение
+    /*!
+      \param i_value Значение, обычно длительность в наносекундах
+    */
+    void Record(std::uint64_t i_value)
+    {
+      buckets[BucketIndex(i_value)].fetch_add(1, std::memory_order_relaxed);
+      count.fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(i_value, std::memory_order_relaxed);
+
+      std::uint64_t current = max.load(std::memory_order_relaxed);
+      while (current < i_value && max.compare_exchange_weak(current, i_value, std::memory_order_relaxed) == false)
+      {
+      }
+    }
+
+    //! Записать одно значение i_times раз
+    /*!
+      \param i_value Значение
+      \param i_times Количество повторений
+    */
+    void Record(std::uint64_t i_value, std::uint64_t i_times);
+
+    //! Получить снимок гистограммы
+    /*!
+      Счетчики читаются по отдельности, поэтому при одновременной записи снимок может быть несогласованным
+      в пределах нескольких значений.
+      \return Снимок
+    */
+    Snapshot GetSnapshot() const;
+
+    //! Получить номер интервала для значения
+    static std::size_t BucketIndex(std::uint64_t i_value)
+    {
+      if (i_value < SUB_BUCKETS)
+      {
+        return static_cast<std::size_t>(i_value);
+      }
+
+      unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(i_value));
+      unsigned shift = exponent - SUB_BUCKET_BITS;
+      std::size_t sub_bucket = static_cast<std::size_t>(i_value >> shift) & (SUB_BUCKETS - 1);
+      return (shift + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    //! Получить нижнюю границу интервала
+    static std::uint64_t BucketLowerBound(std::size_t i_index);
+
+    //! Получить верхнюю границу интервала (включительно)
+    static std::uint64_t BucketUpperBound(std::size_t i_index);
+
+  private:
+    std::atomic<std::uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> max;
+  };
+}
+
+#endif //LOGLIB_LOGGER_STATS_HPP
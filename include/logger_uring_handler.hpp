@@ -0,0 +1,126 @@
+#ifndef LOGLIB_LOGGER_URING_HANDLER_HPP
+#define LOGLIB_LOGGER_URING_HANDLER_HPP
+
+#include <string>
+#include <cstdint>
+
+#include <sys/uio.h>
+
+#include "logger.hpp"
+
+namespace slx
+{
+  //! Обработчик, записывающий события в файл асинхронно через io_uring
+  /*!
+    Пачка событий форматируется в один из двух буферов и отправляется ядру операцией записи,
+    после чего обработчик сразу возвращает управление. Пока ядро записывает один буфер,
+    следующая пачка форматируется во второй. Перед отправкой следующей записи обработчик дожидается
+    завершения предыдущей, поэтому одновременно выполняется не больше одной записи и порядок строк сохраняется.
+    fsync отправляется по политике сброса обработчика, по умолчанию раз в секунду и после событий уровня ERROR.
+    Если io_uring недоступен (старое ядро, запрет seccomp), используется обычный pwrite.
+    Только Linux.
+  */
+  class HandlerUringFile : public HandlerInterface
+  {
+  public:
+    //! Конструктор
+    /*!
+      Открывает файл на дозапись и создает кольцо io_uring.
+      \param i_filename Имя файла
+    */
+    explicit HandlerUringFile(const std::string & i_filename);
+
+    //! Деструктор
+    /*!
+      Дожидается завершения отправленных операций, выполняет fsync и закрывает файл.
+    */
+    ~HandlerUringFile() override;
+
+    //! Проверить, открыт ли файл
+    bool IsOpen() const;
+
+    //! Проверить, используется ли io_uring
+    /*!
+      \return true запись выполняется через io_uring
+      \return false запись выполняется через pwrite
+    */
+    bool IsUringActive() const;
+
+  protected:
+    int HandlerFunction(const LoggerEvent &i_event) override;
+
+    int HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count) override;
+
+    void FlushFunction() override;
+
+    //! Создать кольцо io_uring
+    /*!
+      \return true Успех
+    */
+    bool SetupRing();
+
+    //! Освободить кольцо io_uring
+    void DestroyRing();
+
+    //! Отправить запись буфера и, при необходимости, следующий за ней fsync
+    /*!
+      \param i_index Индекс буфера
+      \param i_sync Отправить fsync после записи
+      \return true Успех
+    */
+    bool Submit(std::size_t i_index, bool i_sync);
+
+    //! Дождаться завершения всех отправленных операций
+    /*!
+      Короткая запись дописывается синхронно, отмененный из-за нее fsync выполняется через fdatasync.
+      Если ожидание невозможно, кольцо освобождается, а отправленный буфер записывается синхронно.
+      \return true Все операции завершились успешно
+    */
+    bool WaitInflight();
+
+    //! Записать данные синхронно через pwrite
+    bool WriteSync(const char *i_data, std::size_t i_size);
+
+    //! Файловый дескриптор
+    int fd;
+    //! Смещение конца данных в файле
+    std::uint64_t offset;
+
+    //! Буферы форматирования
+    std::string buffers[2];
+    //! Описание отправленной записи для каждого буфера
+    struct iovec iovecs[2];
+    //! Индекс буфера, в который форматируется следующая пачка
+    std::size_t current;
+    //! Смещение в файле, по которому отправлена запись буфера
+    std::uint64_t inflight_offset;
+    //! Индекс буфера отправленной записи
+    std::size_t inflight_index;
+    //! Количество отправленных, но не завершенных операций
+    unsigned inflight;
+    //! Запись буфера inflight_index отправлена и еще не завершена
+    bool write_inflight;
+
+    //! Дескриптор кольца io_uring. -1 если io_uring не используется
+    int ring_fd;
+    //! Отображения колец отправки и завершения, массива SQE
+    void * sq_ring;
+    std::size_t sq_ring_size;
+    void * cq_ring;
+    std::size_t cq_ring_size;
+    void * sqes;
+    std::size_t sqes_size;
+
+    //! Указатели на поля колец
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned * sq_mask;
+    unsigned * sq_array;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned * cq_mask;
+    void * cqes;
+  };
+}
+
+#endif //LOGLIB_LOGGER_URING_HANDLER_HPP
@@ -5,9 +5,407 @@
 #include <vector>
 #include <ctime>
 #include <map>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <functional>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LOGGER_HAVE_TSC 1
+#endif
 
 namespace slx
 {
+  struct Logger::StagingBuffer
+  {
+    //! Спин-блокировка буфера. Захватывается владельцем буфера и, по таймеру, потоком обработки
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+
+    //! События, накопленные потоком
+    std::vector<LoggerEvent> events;
+
+    //! Логгер уничтожен, буфер больше не используется
+    std::atomic<bool> orphaned{false};
+
+    void Lock()
+    {
+      while (lock.test_and_set(std::memory_order_acquire) == true)
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    void Unlock()
+    {
+      lock.clear(std::memory_order_release);
+    }
+  };
+
+  struct Logger::HandlersReader
+  {
+    explicit HandlersReader(Logger &i_logger)
+      : logger(i_logger)
+    {
+      // Если эпоха сменилась между чтением и регистрацией, писатель мог уже проверить этот счетчик
+      for (;;)
+      {
+        epoch = logger.handlers_epoch.load();
+        logger.handlers_readers[epoch & 1].fetch_add(1);
+        if (logger.handlers_epoch.load() == epoch)
+        {
+          break;
+        }
+        logger.handlers_readers[epoch & 1].fetch_sub(1);
+      }
+      list = logger.handlers.load();
+
+      previous = top;
+      top = this;
+    }
+
+    ~HandlersReader()
+    {
+      top = previous;
+      logger.handlers_readers[epoch & 1].fetch_sub(1, std::memory_order_release);
+    }
+
+    HandlersReader(const HandlersReader &) = delete;
+
+    HandlersReader & operator=(const HandlersReader &) = delete;
+
+    Logger & logger;
+    unsigned epoch;
+    //! Снимок списка обработчиков
+    const std::vector<tHandler> * list;
+
+    //! Последний созданный читатель текущего потока. Читатели потока вложены, поэтому образуют стек
+    static thread_local const HandlersReader * top;
+    //! Читатель, созданный потоком перед этим
+    const HandlersReader * previous;
+  };
+
+  thread_local const Logger::HandlersReader * Logger::HandlersReader::top = nullptr;
+
+  struct Logger::HandlerGroup
+  {
+    //! Имя группы. Пустое для отдельной группы одного обработчика
+    std::string name;
+
+    //! Обработчики группы. Изменяются только при остановленном потоке
+    std::vector<tHandler> handlers;
+
+    //! Пачки событий, ожидающие обработки. Пачки разделяются между группами
+    std::deque<std::shared_ptr<const std::vector<LoggerEvent>>> queue;
+    //! Количество событий в queue
+    std::size_t backlog = 0;
+    //! Максимальное количество событий в queue
+    std::size_t backlog_limit = DEFAULT_HANDLER_BACKLOG;
+    //! Мютекс для синхронизации доступа к queue
+    std::mutex queue_mtx;
+
+    //! Количество отброшенных событий
+    std::atomic<std::uint64_t> dropped{0};
+
+    //! Поток группы
+    std::thread thread;
+    //! Семафор для передачи сообщений потоку группы
+    BinarySemaphore sem;
+    //! Контроль работы потока
+    std::atomic<bool> active{false};
+  };
+
+  struct Logger::QueueShard
+  {
+    explicit QueueShard(std::size_t i_capacity)
+      : queue(i_capacity)
+    {
+
+    }
+
+    bool TryLock()
+    {
+      return lock.test_and_set(std::memory_order_acquire) == false;
+    }
+
+    void Lock()
+    {
+      while (TryLock() == false)
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    void Unlock()
+    {
+      lock.clear(std::memory_order_release);
+    }
+
+    //! Очередь части
+    RingBuffer<LoggerEvent> queue;
+    //! Пачка событий, извлеченных из queue
+    std::vector<LoggerEvent> drain_batch;
+
+    //! Блокировка производителей. Номер события присваивается и событие помещается в queue под ней,
+    //! поэтому события в queue упорядочены по номерам
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    //! Часть остановлена, события помещаются в events_queue. Изменяется под lock
+    bool stopped = true;
+    //! Количество событий, помещенных в queue. Изменяется под lock
+    std::atomic<std::uint64_t> pushed{0};
+    //! Количество событий, переданных на слияние или вытесненных из queue
+    std::atomic<std::uint64_t> handed{0};
+    //! Номер, следующий за последним переданным на слияние. События части с меньшими номерами уже переданы
+    std::atomic<std::uint64_t> bound{0};
+
+    //! Поток части
+    std::thread thread;
+    //! Семафор для передачи сообщений потоку части
+    BinarySemaphore sem;
+    //! Контроль работы потока
+    std::atomic<bool> active{false};
+  };
+
+  struct Logger::ShardSet
+  {
+    std::vector<std::unique_ptr<QueueShard>> shards;
+    //! Потоки частей запущены, события помещаются в части
+    std::atomic<bool> active{false};
+  };
+
+  namespace
+  {
+    //! Счетчик для выдачи уникальных номеров экземплярам Logger
+    std::atomic<std::uint64_t> g_next_logger_id{1};
+
+    //! Счетчик для выбора части очереди потоками-производителями
+    std::atomic<std::size_t> g_next_shard_hint{0};
+
+    //! Номер части очереди текущего потока (по модулю количества частей)
+    thread_local std::size_t t_shard_hint = g_next_shard_hint.fetch_add(1, std::memory_order_relaxed);
+
+    //! Буферы текущего потока, по одному на каждый логгер, в который поток писал
+    thread_local std::vector<std::pair<std::uint64_t, std::shared_ptr<void>>> t_staging_buffers;
+
+    std::uint32_t ReadThreadId()
+    {
+#ifdef __linux__
+      return static_cast<std::uint32_t>(syscall(SYS_gettid));
+#else
+      return static_cast<std::uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+    }
+
+    //! Идентификатор текущего потока для LoggerEvent::thread_id
+    thread_local std::uint32_t t_thread_id = ReadThreadId();
+
+    //! Разобрать спецификатор долей секунды %3N, %6N, %9N, %N или синонимы %ms (%3N) и %us (%6N)
+    /*!
+      \param o_token_len Длина спецификатора
+      \return количество цифр. 0 - не спецификатор долей секунды
+    */
+    int ParseFraction(const char * i_pos, std::size_t & o_token_len)
+    {
+      if (i_pos[0] == '%' && i_pos[1] == 'N')
+      {
+        o_token_len = 2;
+        return 9;
+      }
+      if (i_pos[0] == '%' && (i_pos[1] == '3' || i_pos[1] == '6' || i_pos[1] == '9') && i_pos[2] == 'N')
+      {
+        o_token_len = 3;
+        return i_pos[1] - '0';
+      }
+      if (i_pos[0] == '%' && (i_pos[1] == 'm' || i_pos[1] == 'u') && i_pos[2] == 's')
+      {
+        o_token_len = 3;
+        return i_pos[1] == 'm' ? 3 : 6;
+      }
+      return 0;
+    }
+
+    //! Записать доли секунды заданным количеством цифр
+    void WriteFraction(char * o_out, std::int64_t i_nanoseconds, int i_digits)
+    {
+      for (int d = 9; d > i_digits; --d)
+      {
+        i_nanoseconds /= 10;
+      }
+      for (int d = i_digits - 1; d >= 0; --d)
+      {
+        o_out[d] = static_cast<char>('0' + i_nanoseconds % 10);
+        i_nanoseconds /= 10;
+      }
+    }
+
+    //! Отформатировать метку времени без кеша
+    /*!
+      Используется, если формат или результат не помещается в кеш FormatTimestampNs.
+      \return длина результата без завершающего нуля
+      \return 0 Результат не поместился в буфер
+    */
+    std::size_t FormatTimestampUncached(char * o_buffer, std::size_t i_size, const char * i_fmt,
+                                        const std::tm & i_tm, std::int64_t i_nanoseconds)
+    {
+      std::string part;
+      std::size_t length = 0;
+      const char * p = i_fmt;
+      for (;;)
+      {
+        std::size_t token_len = 0;
+        int digits = ParseFraction(p, token_len);
+
+        if (digits != 0 || *p == '\0')
+        {
+          if (part.empty() == false)
+          {
+            std::size_t res = std::strftime(o_buffer + length, i_size - length, part.c_str(), &i_tm);
+            if (res == 0)
+            {
+              return 0;
+            }
+            length += res;
+            part.clear();
+          }
+
+          if (*p == '\0')
+          {
+            break;
+          }
+
+          if (length + static_cast<std::size_t>(digits) >= i_size)
+          {
+            return 0;
+          }
+          WriteFraction(o_buffer + length, i_nanoseconds, digits);
+          length += static_cast<std::size_t>(digits);
+          p += token_len;
+          continue;
+        }
+
+        if (*p == '%' && p[1] == '%')
+        {
+          part += *p++;
+        }
+        part += *p++;
+      }
+
+      if (length >= i_size)
+      {
+        return 0;
+      }
+      o_buffer[length] = '\0';
+      return length;
+    }
+
+    //! Получить копию строки, которая не освобождается до завершения процесса
+    /*!
+      Одинаковые строки возвращаются одним указателем
+    */
+    const char * InternString(const std::string & i_string)
+    {
+      static std::mutex strings_mtx;
+      static std::set<std::string> strings;
+
+      std::unique_lock<std::mutex> lock(strings_mtx);
+      return strings.insert(i_string).first->c_str();
+    }
+
+    void CpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      _mm_pause();
+#elif defined(__aarch64__)
+      asm volatile("yield");
+#endif
+    }
+
+    //! Заснуть, если слово равно i_expected
+    /*!
+      Возврат возможен и без пробуждения (по сигналу, при изменении слова), вызывающий проверяет состояние сам.
+    */
+    void FutexWait(std::atomic<std::uint32_t> *i_word, std::uint32_t i_expected, const std::chrono::microseconds *i_timeout)
+    {
+#ifdef __linux__
+      timespec timeout;
+      timespec * timeout_ptr = nullptr;
+      if (i_timeout != nullptr)
+      {
+        timeout.tv_sec = static_cast<time_t>(i_timeout->count() / 1000000);
+        timeout.tv_nsec = static_cast<long>(i_timeout->count() % 1000000) * 1000;
+        timeout_ptr = &timeout;
+      }
+      syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(i_word), FUTEX_WAIT_PRIVATE, i_expected, timeout_ptr, nullptr, 0);
+#else
+      // Без futex сон выполняется короткими интервалами
+      std::chrono::microseconds step(1000);
+      if (i_timeout != nullptr && *i_timeout < step)
+      {
+        step = *i_timeout;
+      }
+      if (i_word->load(std::memory_order_acquire) == i_expected)
+      {
+        std::this_thread::sleep_for(step);
+      }
+#endif
+    }
+
+    void FutexWake(std::atomic<std::uint32_t> *i_word)
+    {
+#ifdef __linux__
+      syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(i_word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+      (void)i_word;
+#endif
+    }
+
+    std::int64_t ReadClock(clockid_t i_clock)
+    {
+      timespec ts;
+      clock_gettime(i_clock, &ts);
+      return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+#ifdef LOGGER_HAVE_TSC
+    //! Калибровка счетчика тактов по CLOCK_REALTIME
+    struct TscCalibration
+    {
+      std::uint64_t base_tsc = 0;
+      std::int64_t base_ns = 0;
+      double ns_per_tick = 0;
+    };
+
+    const TscCalibration & GetTscCalibration()
+    {
+      static TscCalibration calibration;
+      static std::once_flag once;
+
+      std::call_once(once, []()
+      {
+        std::uint64_t tsc_begin = __rdtsc();
+        std::int64_t ns_begin = ReadClock(CLOCK_REALTIME);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::uint64_t tsc_end = __rdtsc();
+        std::int64_t ns_end = ReadClock(CLOCK_REALTIME);
+
+        calibration.base_tsc = tsc_end;
+        calibration.base_ns = ns_end;
+        calibration.ns_per_tick = static_cast<double>(ns_end - ns_begin) / static_cast<double>(tsc_end - tsc_begin);
+      });
+
+      return calibration;
+    }
+#endif
+  }
+
   extern const std::map<LoggerEvent::Level, std::string> g_log_level_strings
     {
       {LoggerEvent::Level::TRACE,     std::string{"TRACE"}},
@@ -18,319 +416,2396 @@ namespace slx
       {LoggerEvent::Level::FATAL,     std::string{"FATAL"}}
     };
 
-  BinarySemaphore::BinarySemaphore(bool i_val)
-    : notified(i_val)
-  {
+  EventData::EventData()
+    : heap_capacity(0)
+    , len(0)
+    , on_heap(false)
+  {
+    inline_buffer[0] = '\0';
+  }
+
+  EventData::EventData(const EventData &i_other)
+    : EventData()
+  {
+    assign(i_other.data(), i_other.size());
+  }
+
+  EventData::EventData(EventData &&i_other) noexcept
+    : EventData()
+  {
+    *this = std::move(i_other);
+  }
+
+  EventData::EventData(const std::string &i_str)
+    : EventData()
+  {
+    assign(i_str.data(), i_str.size());
+  }
+
+  EventData::EventData(const char *i_str)
+    : EventData()
+  {
+    assign(i_str, std::strlen(i_str));
+  }
+
+  EventData & EventData::operator=(const EventData &i_other)
+  {
+    if (this != &i_other)
+    {
+      assign(i_other.data(), i_other.size());
+    }
+    return *this;
+  }
+
+  EventData & EventData::operator=(EventData &&i_other) noexcept
+  {
+    if (this == &i_other)
+    {
+      return *this;
+    }
+
+    if (i_other.on_heap == true)
+    {
+      // Буферы меняются местами, чтобы выделенная память продолжала использоваться
+      heap.swap(i_other.heap);
+      std::swap(heap_capacity, i_other.heap_capacity);
+      len = i_other.len;
+      on_heap = true;
+    }
+    else
+    {
+      std::memcpy(inline_buffer, i_other.inline_buffer, i_other.len + 1);
+      len = i_other.len;
+      on_heap = false;
+    }
+
+    i_other.clear();
+    return *this;
+  }
+
+  EventData & EventData::operator=(const std::string &i_str)
+  {
+    assign(i_str.data(), i_str.size());
+    return *this;
+  }
+
+  EventData & EventData::operator=(const char *i_str)
+  {
+    assign(i_str, std::strlen(i_str));
+    return *this;
+  }
+
+  void EventData::assign(const char *i_data, std::size_t i_size)
+  {
+    Reserve(i_size + 1);
+    char * buffer = on_heap ? heap.get() : inline_buffer;
+    std::memmove(buffer, i_data, i_size);
+    buffer[i_size] = '\0';
+    len = i_size;
+  }
+
+  void EventData::append(const char *i_data, std::size_t i_size)
+  {
+    Reserve(len + i_size + 1);
+    char * buffer = on_heap ? heap.get() : inline_buffer;
+    std::memmove(buffer + len, i_data, i_size);
+    len += i_size;
+    buffer[len] = '\0';
+  }
+
+  void EventData::clear()
+  {
+    len = 0;
+    on_heap = false;
+    inline_buffer[0] = '\0';
+  }
+
+  const char * EventData::data() const
+  {
+    return on_heap ? heap.get() : inline_buffer;
+  }
+
+  const char * EventData::c_str() const
+  {
+    return data();
+  }
+
+  std::size_t EventData::size() const
+  {
+    return len;
+  }
+
+  std::size_t EventData::length() const
+  {
+    return len;
+  }
+
+  bool EventData::empty() const
+  {
+    return len == 0;
+  }
+
+  std::string EventData::str() const
+  {
+    return std::string(data(), len);
+  }
+
+  EventData::operator std::string() const
+  {
+    return str();
+  }
+
+  bool EventData::Format(const char *i_fmt, va_list i_args)
+  {
+    va_list temp_args;
+    va_copy(temp_args, i_args);
+
+    std::size_t capacity = on_heap ? heap_capacity : INLINE_CAPACITY;
+    char * buffer = on_heap ? heap.get() : inline_buffer;
+    int res = vsnprintf(buffer, capacity, i_fmt, temp_args);
+    va_end(temp_args);
+
+    if (res < 0)
+    {
+      clear();
+      return false;
+    }
+
+    if (static_cast<std::size_t>(res) >= capacity)
+    {
+      Reserve(static_cast<std::size_t>(res) + 1);
+      va_copy(temp_args, i_args);
+      res = vsnprintf(heap.get(), heap_capacity, i_fmt, temp_args);
+      va_end(temp_args);
+
+      if (res < 0)
+      {
+        clear();
+        return false;
+      }
+    }
+
+    len = static_cast<std::size_t>(res);
+    return true;
+  }
+
+  void EventData::Reserve(std::size_t i_capacity)
+  {
+    if (i_capacity <= INLINE_CAPACITY)
+    {
+      if (on_heap == true)
+      {
+        std::memcpy(inline_buffer, heap.get(), std::min(len + 1, i_capacity));
+        on_heap = false;
+      }
+      return;
+    }
+
+    if (i_capacity > heap_capacity)
+    {
+      std::size_t new_capacity = std::max(i_capacity, heap_capacity * 2);
+      std::unique_ptr<char[]> new_heap(new char[new_capacity]);
+      std::memcpy(new_heap.get(), data(), len + 1);
+      heap.swap(new_heap);
+      heap_capacity = new_capacity;
+    }
+    else if (on_heap == false)
+    {
+      std::memcpy(heap.get(), inline_buffer, len + 1);
+    }
+
+    on_heap = true;
+  }
+
+  std::ostream & operator<<(std::ostream &o_stream, const EventData &i_data)
+  {
+    return o_stream.write(i_data.data(), static_cast<std::streamsize>(i_data.size()));
+  }
+
+  BinarySemaphore::BinarySemaphore(bool i_val)
+    : state(i_val ? STATE_NOTIFIED : 0)
+  {
+
+  }
+
+  void BinarySemaphore::Notify()
+  {
+    // Проверка флага обычным чтением без записи может пропустить сигнал: чтение может выполниться раньше
+    // записи события в очередь, а ожидающий поток - сбросить флаг и не увидеть событие.
+    // Операция чтения-записи упорядочена со сбросом флага в SpinWait и Park
+    std::uint32_t previous = state.fetch_or(STATE_NOTIFIED, std::memory_order_acq_rel);
+    if ((previous & STATE_SLEEPING) != 0)
+    {
+      FutexWake(&state);
+    }
+  }
+
+  void BinarySemaphore::Wait()
+  {
+    if (SpinWait() == true)
+    {
+      return;
+    }
+
+    while (Park(nullptr) == false)
+    {
+    }
+  }
+
+  bool BinarySemaphore::WaitFor(std::chrono::microseconds i_timeout)
+  {
+    if (SpinWait() == true)
+    {
+      return true;
+    }
+
+    return Park(&i_timeout);
+  }
+
+  bool BinarySemaphore::SpinWait()
+  {
+    for (unsigned i = 0; i < SPIN_COUNT + YIELD_COUNT; ++i)
+    {
+      if ((state.load(std::memory_order_acquire) & STATE_NOTIFIED) != 0)
+      {
+        state.fetch_and(~STATE_NOTIFIED, std::memory_order_acq_rel);
+        return true;
+      }
+
+      if (i < SPIN_COUNT)
+      {
+        CpuRelax();
+      }
+      else
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    return false;
+  }
+
+  bool BinarySemaphore::Park(const std::chrono::microseconds *i_timeout)
+  {
+    // Сигнал, пришедший после установки флага сна, меняет слово, и futex не засыпает
+    std::uint32_t previous = state.fetch_or(STATE_SLEEPING, std::memory_order_acq_rel);
+    if ((previous & STATE_NOTIFIED) == 0)
+    {
+      FutexWait(&state, STATE_SLEEPING, i_timeout);
+    }
+
+    previous = state.exchange(0, std::memory_order_acq_rel);
+    return (previous & STATE_NOTIFIED) != 0;
+  }
+
+  int HandlerInterface::HandleEvent(const LoggerEvent &i_event)
+  {
+    return HandleEvents(&i_event, 1);
+  }
+
+  int HandlerInterface::HandleEvents(const LoggerEvent *i_events, std::size_t i_count)
+  {
+    if (flag_enabled == false)
+    {
+      return 0;
+    }
+
+    std::unique_lock<std::mutex> events_lock(events_mtx);
+
+    LoggerEvent::Level level = log_level.load(std::memory_order_relaxed);
+    batch_events.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      if (level <= i_events[i].level)
+      {
+        batch_events.push_back(&i_events[i]);
+      }
+    }
+
+    if (batch_events.empty() == true)
+    {
+      return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int result = HandlerFunctionBatch(batch_events.data(), batch_events.size());
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+    call_time.Record(static_cast<std::uint64_t>(elapsed.count()));
+    stats_calls.fetch_add(1, std::memory_order_relaxed);
+    stats_events.fetch_add(batch_events.size(), std::memory_order_relaxed);
+    if (result != 0)
+    {
+      stats_errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return result;
+  }
+
+  HandlerInterface::Stats HandlerInterface::GetStats() const
+  {
+    Stats stats;
+    stats.calls = stats_calls.load(std::memory_order_relaxed);
+    stats.events = stats_events.load(std::memory_order_relaxed);
+    stats.errors = stats_errors.load(std::memory_order_relaxed);
+    stats.call_time = call_time.GetSnapshot();
+    return stats;
+  }
+
+  void HandlerInterface::Flush()
+  {
+    std::unique_lock<std::mutex> events_lock(events_mtx);
+
+    FlushFunction();
+    unflushed_count = 0;
+    last_flush = std::chrono::steady_clock::now();
+  }
+
+  bool HandlerInterface::IsRenderRequired() const
+  {
+    return true;
+  }
+
+  bool HandlerInterface::IsOrderRequired() const
+  {
+    return true;
+  }
+
+  void HandlerInterface::FlushIfDue()
+  {
+    std::unique_lock<std::mutex> events_lock(events_mtx);
+
+    if (unflushed_count == 0 || flush_policy.interval.count() == 0)
+    {
+      return;
+    }
+
+    if (std::chrono::steady_clock::now() - last_flush >= flush_policy.interval)
+    {
+      FlushFunction();
+      unflushed_count = 0;
+      last_flush = std::chrono::steady_clock::now();
+    }
+  }
+
+  HandlerInterface::FlushPolicy HandlerInterface::GetFlushPolicy() const
+  {
+    std::unique_lock<std::mutex> lock(events_mtx);
+    return flush_policy;
+  }
+
+  void HandlerInterface::SetFlushPolicy(const FlushPolicy &i_policy)
+  {
+    std::unique_lock<std::mutex> lock(events_mtx);
+    flush_policy = i_policy;
+  }
+
+  int HandlerInterface::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    int result = 0;
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      int res = HandlerFunction(*i_events[i]);
+      if (res != 0)
+      {
+        result = res;
+      }
+    }
+    return result;
+  }
+
+  void HandlerInterface::FlushFunction()
+  {
+
+  }
+
+  bool HandlerInterface::FlushRequired(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    unflushed_count += i_count;
+
+    bool required = false;
+    if (flush_policy.every_n != 0 && unflushed_count >= flush_policy.every_n)
+    {
+      required = true;
+    }
+    else if (flush_policy.interval.count() != 0
+             && std::chrono::steady_clock::now() - last_flush >= flush_policy.interval)
+    {
+      required = true;
+    }
+    else
+    {
+      for (std::size_t i = 0; i < i_count; ++i)
+      {
+        if (i_events[i]->level >= flush_policy.level)
+        {
+          required = true;
+          break;
+        }
+      }
+    }
+
+    if (required == true)
+    {
+      unflushed_count = 0;
+      last_flush = std::chrono::steady_clock::now();
+    }
+    return required;
+  }
+
+  LoggerEvent::Level HandlerInterface::GetLogLevel() const
+  {
+    return log_level;
+  }
+
+  void HandlerInterface::SetLogLevel(LoggerEvent::Level i_level)
+  {
+    log_level = i_level;
+    NotifyLoggers();
+  }
+
+  bool HandlerInterface::IsEnabled() const
+  {
+    return flag_enabled;
+  }
+
+  void HandlerInterface::Enable()
+  {
+    flag_enabled = true;
+    NotifyLoggers();
+  }
+
+  void HandlerInterface::Disable()
+  {
+    flag_enabled = false;
+    NotifyLoggers();
+  }
+
+  void HandlerInterface::AttachLogger(Logger *i_logger)
+  {
+    std::unique_lock<std::mutex> loggers_lock(loggers_mtx);
+    loggers.push_back(i_logger);
+  }
+
+  void HandlerInterface::DetachLogger(Logger *i_logger)
+  {
+    std::unique_lock<std::mutex> loggers_lock(loggers_mtx);
+    auto it = std::find(loggers.begin(), loggers.end(), i_logger);
+    if (it != loggers.end())
+    {
+      loggers.erase(it);
+    }
+  }
+
+  void HandlerInterface::NotifyLoggers()
+  {
+    std::unique_lock<std::mutex> loggers_lock(loggers_mtx);
+    for (auto logger : loggers)
+    {
+      logger->UpdateLevelMask();
+    }
+  }
+
+  Logger::Logger(const Logger::Mode & i_mode, std::size_t i_queue_capacity)
+    : mode(Logger::Mode::DISABLED)
+    , instance_id(g_next_logger_id++)
+    , clock_source(Logger::ClockSource::REALTIME)
+    , name(nullptr)
+    , next_sequence(0)
+    , level_mask(0)
+    , events_queue(i_queue_capacity)
+    , overflow_policy(Logger::OverflowPolicy::BLOCK)
+    , block_timeout(DEFAULT_BLOCK_TIMEOUT.count())
+    , drop_level(LoggerEvent::Level::WARN)
+    , dropped_newest(0)
+    , dropped_oldest(0)
+    , dropped_below_level(0)
+    , dropped_timeout(0)
+    , stats_processed(0)
+    , queue_high_water(0)
+    , journal(nullptr)
+    , staging_capacity(DEFAULT_STAGING_CAPACITY)
+    , flush_interval(DEFAULT_FLUSH_INTERVAL.count())
+    , worker_max_sleep(DEFAULT_WORKER_MAX_SLEEP.count())
+    , published_count(0)
+    , worker_active(false)
+    , handlers(new std::vector<tHandler>())
+    , handlers_epoch(0)
+    , worker_count(DEFAULT_WORKER_COUNT)
+    , shard_set(nullptr)
+    , merge_count(0)
+    , merge_held_count(0)
+    , groups_running(false)
+  {
+    handlers_readers[0] = 0;
+    handlers_readers[1] = 0;
+
+    SetMode(i_mode);
+  }
+
+  Logger::~Logger()
+  {
+    SetMode(Logger::Mode::DISABLED);
+
+    // После DetachLogger обработчики больше не вызывают UpdateLevelMask этого логгера
+    std::vector<tHandler> * detached = handlers.load();
+    for (auto & handler : *detached)
+    {
+      handler->DetachLogger(this);
+    }
+    delete detached;
+    for (auto list : handlers_retired)
+    {
+      delete list;
+    }
+
+    delete journal.load();
+
+    std::unique_lock<std::mutex> staging_lock(staging_mtx);
+    for (auto & buffer : staging_buffers)
+    {
+      buffer->orphaned = true;
+    }
+  }
+
+  Logger::Mode Logger::GetMode() const
+  {
+    return mode;
+  }
+
+  void Logger::SetMode(const Logger::Mode &i_mode)
+  {
+    Logger::Mode old_mode = mode;
+    if (old_mode == i_mode)
+    {
+      return;
+    }
+
+    if (IsAsyncMode(old_mode) == true)
+    {
+      // Потоки частей передают остаток событий на слияние, пока основной поток еще работает
+      StopShards();
+
+      worker_active = false;
+      worker_sem.Notify();
+      worker_thread.join();
+
+      DrainMergeBatches();
+      DrainQueue();
+      DrainStagingBuffers();
+    }
+
+    if (old_mode == Logger::Mode::ASYNC_PER_HANDLER)
+    {
+      std::unique_lock<std::mutex> groups_lock(groups_mtx);
+      for (auto & group : handler_groups)
+      {
+        StopHandlerGroup(*group);
+      }
+      groups_running = false;
+    }
+
+    mode = i_mode;
+
+    if (i_mode == Logger::Mode::ASYNC_PER_HANDLER)
+    {
+      std::unique_lock<std::mutex> groups_lock(groups_mtx);
+      groups_running = true;
+      for (auto & group : handler_groups)
+      {
+        StartHandlerGroup(*group);
+      }
+    }
+
+    if (IsAsyncMode(i_mode) == true)
+    {
+      worker_active = true;
+      worker_thread = std::thread(QueueWorker, this);
+    }
+
+    if (i_mode == Logger::Mode::ASYNC)
+    {
+      StartShards();
+    }
+  }
+
+  std::size_t Logger::GetQueueCapacity() const
+  {
+    return events_queue.Capacity();
+  }
+
+  std::size_t Logger::GetWorkerCount() const
+  {
+    return worker_count;
+  }
+
+  void Logger::SetWorkerCount(std::size_t i_count)
+  {
+    i_count = std::max<std::size_t>(i_count, 1);
+    if (worker_count.exchange(i_count) == i_count)
+    {
+      return;
+    }
+
+    if (mode == Logger::Mode::ASYNC)
+    {
+      SetMode(Logger::Mode::SYNC);
+      SetMode(Logger::Mode::ASYNC);
+    }
+  }
+
+  std::string Logger::GetName() const
+  {
+    const char * current = name.load(std::memory_order_acquire);
+    return current != nullptr ? std::string(current) : std::string();
+  }
+
+  void Logger::SetName(const std::string &i_name)
+  {
+    name.store(i_name.empty() == true ? nullptr : InternString(i_name), std::memory_order_release);
+  }
+
+  Logger::ClockSource Logger::GetClockSource() const
+  {
+    return clock_source;
+  }
+
+  void Logger::SetClockSource(Logger::ClockSource i_source)
+  {
+#ifdef LOGGER_HAVE_TSC
+    if (i_source == Logger::ClockSource::TSC)
+    {
+      GetTscCalibration();
+    }
+#else
+    if (i_source == Logger::ClockSource::TSC)
+    {
+      i_source = Logger::ClockSource::REALTIME;
+    }
+#endif
+    clock_source = i_source;
+  }
+
+  std::int64_t Logger::GetTimeNs() const
+  {
+    switch (clock_source.load(std::memory_order_relaxed))
+    {
+#ifdef CLOCK_REALTIME_COARSE
+      case Logger::ClockSource::REALTIME_COARSE:
+        return ReadClock(CLOCK_REALTIME_COARSE);
+#endif
+#ifdef LOGGER_HAVE_TSC
+      case Logger::ClockSource::TSC:
+      {
+        const TscCalibration & calibration = GetTscCalibration();
+        std::int64_t ticks = static_cast<std::int64_t>(__rdtsc() - calibration.base_tsc);
+        return calibration.base_ns + static_cast<std::int64_t>(static_cast<double>(ticks) * calibration.ns_per_tick);
+      }
+#endif
+      default:
+        return ReadClock(CLOCK_REALTIME);
+    }
+  }
+
+  std::size_t Logger::GetStagingCapacity() const
+  {
+    return staging_capacity;
+  }
+
+  void Logger::SetStagingCapacity(std::size_t i_capacity)
+  {
+    staging_capacity = std::max<std::size_t>(i_capacity, 1);
+  }
+
+  std::chrono::microseconds Logger::GetFlushInterval() const
+  {
+    return std::chrono::microseconds(flush_interval.load());
+  }
+
+  void Logger::SetFlushInterval(std::chrono::microseconds i_interval)
+  {
+    flush_interval = i_interval.count();
+  }
+
+  std::chrono::microseconds Logger::GetWorkerMaxSleep() const
+  {
+    return std::chrono::microseconds(worker_max_sleep.load());
+  }
+
+  void Logger::SetWorkerMaxSleep(std::chrono::microseconds i_sleep)
+  {
+    worker_max_sleep = std::max<std::chrono::microseconds::rep>(i_sleep.count(), 1);
+  }
+
+  std::chrono::microseconds Logger::GetWorkerSleep() const
+  {
+    std::chrono::microseconds sleep = GetWorkerMaxSleep();
+    if (mode == Logger::Mode::ASYNC_BUFFERED)
+    {
+      sleep = std::min(sleep, GetFlushInterval());
+    }
+    return sleep;
+  }
+
+  Logger::OverflowPolicy Logger::GetOverflowPolicy() const
+  {
+    return overflow_policy;
+  }
+
+  void Logger::SetOverflowPolicy(Logger::OverflowPolicy i_policy)
+  {
+    overflow_policy = i_policy;
+  }
+
+  std::chrono::milliseconds Logger::GetBlockTimeout() const
+  {
+    return std::chrono::milliseconds(block_timeout.load());
+  }
+
+  void Logger::SetBlockTimeout(std::chrono::milliseconds i_timeout)
+  {
+    block_timeout = i_timeout.count();
+  }
+
+  LoggerEvent::Level Logger::GetDropLevel() const
+  {
+    return drop_level;
+  }
+
+  void Logger::SetDropLevel(LoggerEvent::Level i_level)
+  {
+    drop_level = i_level;
+  }
+
+  Logger::DropCounters Logger::GetDropCounters() const
+  {
+    DropCounters counters;
+    counters.newest = dropped_newest;
+    counters.oldest = dropped_oldest;
+    counters.below_level = dropped_below_level;
+    counters.timeout = dropped_timeout;
+    return counters;
+  }
+
+  Logger::Stats Logger::GetStats() const
+  {
+    Stats stats;
+    stats.drops = GetDropCounters();
+    stats.logged = next_sequence.load(std::memory_order_relaxed);
+    std::uint64_t dropped = stats.drops.newest + stats.drops.oldest + stats.drops.below_level + stats.drops.timeout;
+    stats.enqueued = stats.logged > dropped ? stats.logged - dropped : 0;
+    stats.processed = stats_processed.load(std::memory_order_relaxed);
+    stats.queue_depth = events_queue.Size() + merge_count.load(std::memory_order_relaxed)
+                        + merge_held_count.load(std::memory_order_relaxed);
+    ShardSet * set = shard_set.load(std::memory_order_acquire);
+    if (set != nullptr)
+    {
+      for (const auto & shard : set->shards)
+      {
+        stats.queue_depth += shard->queue.Size();
+      }
+    }
+    stats.queue_high_water = queue_high_water.load(std::memory_order_relaxed);
+    stats.dispatch_latency = dispatch_latency.GetSnapshot();
+    return stats;
+  }
+
+  void Logger::UpdateQueueHighWater(std::size_t i_depth)
+  {
+    std::size_t current = queue_high_water.load(std::memory_order_relaxed);
+    while (current < i_depth && queue_high_water.compare_exchange_weak(current, i_depth, std::memory_order_relaxed) == false)
+    {
+    }
+  }
+
+  void Logger::RecordDispatch(const LoggerEvent *i_events, std::size_t i_count)
+  {
+    // Часы читаются один раз на пачку
+    std::int64_t now = GetTimeNs();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      std::int64_t wait = now - i_events[i].time_ns;
+      dispatch_latency.Record(wait > 0 ? static_cast<std::uint64_t>(wait) : 0);
+    }
+    stats_processed.fetch_add(i_count, std::memory_order_relaxed);
+  }
+
+  std::size_t Logger::GetHandlersCount()
+  {
+    HandlersReader reader(*this);
+
+    return reader.list->size();
+  }
+
+  tHandler Logger::GetHandlerByIndex(std::size_t i_index)
+  {
+    HandlersReader reader(*this);
+
+    if (i_index < reader.list->size())
+    {
+      return (*reader.list)[i_index];
+    }
+
+    return tHandler();
+  }
+
+  void Logger::UpdateLevelMask()
+  {
+    // Список и состояние обработчиков читаются под мютексом, поэтому последний пересчет видит последние изменения
+    std::unique_lock<std::mutex> level_mask_lock(level_mask_mtx);
+    HandlersReader reader(*this);
+
+    unsigned mask = 0;
+    for (const auto & handler : *reader.list)
+    {
+      if (handler->IsEnabled() == true)
+      {
+        // Обработчик принимает все уровни не ниже своего
+        unsigned level = static_cast<unsigned>(handler->GetLogLevel());
+        unsigned all = (1u << (static_cast<unsigned>(LoggerEvent::Level::FATAL) + 1)) - 1;
+        mask |= all & ~((1u << level) - 1);
+      }
+    }
+
+    level_mask = mask;
+  }
+
+  void Logger::PublishHandlers(std::vector<tHandler> *i_handlers)
+  {
+    handlers_retired.push_back(handlers.exchange(i_handlers));
+    // Читатели, начавшие работу после переключения эпохи, получают новый снимок
+    handlers_epoch.fetch_add(1);
+
+    // Читатель не переходит между счетчиками, поэтому при двух нулевых счетчиках
+    // все читатели сохраненных снимков уже завершились
+    if (handlers_readers[0].load() == 0 && handlers_readers[1].load() == 0)
+    {
+      for (auto list : handlers_retired)
+      {
+        delete list;
+      }
+      handlers_retired.clear();
+    }
+  }
+
+  bool Logger::WaitHandlersReaders()
+  {
+    // Читатели самого потока не завершатся во время ожидания
+    std::size_t own[2] = {0, 0};
+    for (const HandlersReader * reader = HandlersReader::top; reader != nullptr; reader = reader->previous)
+    {
+      if (&reader->logger == this)
+      {
+        ++own[reader->epoch & 1];
+      }
+    }
+
+    // Каждый счетчик проверяется, когда текущая эпоха имеет другую четность,
+    // поэтому новые читатели его не пополняют и ожидание не затягивается потоком событий
+    for (unsigned parity = 0; parity < 2; ++parity)
+    {
+      if ((handlers_epoch.load() & 1) == parity)
+      {
+        handlers_epoch.fetch_add(1);
+      }
+      while (handlers_readers[parity].load() != own[parity])
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    return own[0] != 0 || own[1] != 0;
+  }
+
+  void Logger::ReclaimHandlers()
+  {
+    std::vector<std::vector<tHandler> *> retired;
+    handlers_mtx.lock();
+    retired.swap(handlers_retired);
+    handlers_mtx.unlock();
+
+    if (WaitHandlersReaders() == true)
+    {
+      // Поток, вызвавший удаление из обработчика, сам читает один из снимков. Снимки освобождаются позже
+      handlers_mtx.lock();
+      handlers_retired.insert(handlers_retired.end(), retired.begin(), retired.end());
+      handlers_mtx.unlock();
+      return;
+    }
+
+    for (auto list : retired)
+    {
+      delete list;
+    }
+  }
+
+  Logger::ReturnCode Logger::AddHandler(const tHandler & i_handler)
+  {
+    handlers_mtx.lock();
+    const std::vector<tHandler> & current = *handlers.load();
+    for (const auto & handler : current)
+    {
+      if (i_handler.get() == handler.get())
+      {
+        handlers_mtx.unlock();
+        return ERROR_HANDLER_NOT_UNIQUE;
+      }
+    }
+
+    std::vector<tHandler> * updated = new std::vector<tHandler>(current);
+    updated->push_back(i_handler);
+    PublishHandlers(updated);
+    handlers_mtx.unlock();
+
+    groups_mtx.lock();
+    JoinHandlerGroup(i_handler, std::string());
+    groups_mtx.unlock();
+
+    i_handler->AttachLogger(this);
+    UpdateLevelMask();
+    return RET_SUCCESS;
+  }
+
+  Logger::ReturnCode Logger::DelHandler(const tHandler & i_handler)
+  {
+    handlers_mtx.lock();
+    const std::vector<tHandler> & current = *handlers.load();
+    for (std::size_t i = 0; i < current.size(); ++i)
+    {
+      if (i_handler.get() == current[i].get())
+      {
+        std::vector<tHandler> * updated = new std::vector<tHandler>(current);
+        updated->erase(updated->begin() + static_cast<std::ptrdiff_t>(i));
+        PublishHandlers(updated);
+        handlers_mtx.unlock();
+
+        // После возврата обработчик не вызывается читателями старых снимков
+        ReclaimHandlers();
+
+        groups_mtx.lock();
+        LeaveHandlerGroup(i_handler.get());
+        groups_mtx.unlock();
+
+        i_handler->DetachLogger(this);
+        UpdateLevelMask();
+        return RET_SUCCESS;
+      }
+    }
+    handlers_mtx.unlock();
+
+    return ERROR_HANDLER_NOT_FOUND;
+  }
+
+  Logger::ReturnCode Logger::DelHandlerByIndex(std::size_t i_index)
+  {
+    tHandler removed;
+
+    handlers_mtx.lock();
+    const std::vector<tHandler> & current = *handlers.load();
+    if (i_index < current.size())
+    {
+      removed = current[i_index];
+      std::vector<tHandler> * updated = new std::vector<tHandler>(current);
+      updated->erase(updated->begin() + static_cast<std::ptrdiff_t>(i_index));
+      PublishHandlers(updated);
+    }
+    handlers_mtx.unlock();
+
+    if (removed == nullptr)
+    {
+      return ERROR_HANDLER_NOT_FOUND;
+    }
+
+    // После возврата обработчик не вызывается читателями старых снимков
+    ReclaimHandlers();
+
+    groups_mtx.lock();
+    LeaveHandlerGroup(removed.get());
+    groups_mtx.unlock();
+
+    removed->DetachLogger(this);
+    UpdateLevelMask();
+    return RET_SUCCESS;
+  }
+
+  Logger::ReturnCode Logger::SetHandlerGroup(const tHandler & i_handler, const std::string & i_group)
+  {
+    std::unique_lock<std::mutex> groups_lock(groups_mtx);
+
+    if (FindHandlerGroup(i_handler.get()) == nullptr)
+    {
+      return ERROR_HANDLER_NOT_FOUND;
+    }
+
+    LeaveHandlerGroup(i_handler.get());
+    JoinHandlerGroup(i_handler, i_group);
+    return RET_SUCCESS;
+  }
+
+  Logger::ReturnCode Logger::SetHandlerBacklog(const tHandler & i_handler, std::size_t i_limit)
+  {
+    std::unique_lock<std::mutex> groups_lock(groups_mtx);
+
+    HandlerGroup * group = FindHandlerGroup(i_handler.get());
+    if (group == nullptr)
+    {
+      return ERROR_HANDLER_NOT_FOUND;
+    }
+
+    std::unique_lock<std::mutex> queue_lock(group->queue_mtx);
+    group->backlog_limit = i_limit;
+    return RET_SUCCESS;
+  }
+
+  std::uint64_t Logger::GetHandlerDropCount(const tHandler & i_handler)
+  {
+    std::unique_lock<std::mutex> groups_lock(groups_mtx);
+
+    HandlerGroup * group = FindHandlerGroup(i_handler.get());
+    if (group == nullptr)
+    {
+      return 0;
+    }
+
+    return group->dropped;
+  }
+
+  Logger::ReturnCode Logger::EnableJournal(const std::string & i_filename, std::size_t i_capacity
+                                           , std::size_t *o_recovered)
+  {
+    std::unique_lock<std::mutex> journal_lock(journal_mtx);
+
+    if (journal.load() != nullptr)
+    {
+      return ERROR_JOURNAL_UNAVAILABLE;
+    }
+
+    std::unique_ptr<EventJournal> opened(new EventJournal());
+    std::vector<LoggerEvent> recovered;
+    if (opened->Open(i_filename, i_capacity, recovered) == false)
+    {
+      return ERROR_JOURNAL_UNAVAILABLE;
+    }
+
+    if (recovered.empty() == false)
+    {
+      ProcessEvents(recovered.data(), recovered.size());
+    }
+    if (o_recovered != nullptr)
+    {
+      *o_recovered = recovered.size();
+    }
+
+    journal.store(opened.release(), std::memory_order_release);
+    return RET_SUCCESS;
+  }
+
+  Logger::HandlerGroup * Logger::FindHandlerGroup(const HandlerInterface *i_handler)
+  {
+    for (auto & group : handler_groups)
+    {
+      for (const auto & handler : group->handlers)
+      {
+        if (handler.get() == i_handler)
+        {
+          return group.get();
+        }
+      }
+    }
+
+    return nullptr;
+  }
+
+  void Logger::JoinHandlerGroup(const tHandler & i_handler, const std::string & i_group)
+  {
+    HandlerGroup * target = nullptr;
+    if (i_group.empty() == false)
+    {
+      for (auto & group : handler_groups)
+      {
+        if (group->name == i_group)
+        {
+          target = group.get();
+          break;
+        }
+      }
+    }
+
+    if (target == nullptr)
+    {
+      handler_groups.push_back(std::make_unique<HandlerGroup>());
+      target = handler_groups.back().get();
+      target->name = i_group;
+    }
+    else if (groups_running == true)
+    {
+      StopHandlerGroup(*target);
+    }
+
+    target->handlers.push_back(i_handler);
+
+    if (groups_running == true)
+    {
+      StartHandlerGroup(*target);
+    }
+  }
+
+  void Logger::LeaveHandlerGroup(const HandlerInterface *i_handler)
+  {
+    for (auto it = handler_groups.begin(); it != handler_groups.end(); ++it)
+    {
+      HandlerGroup & group = **it;
+      auto found = std::find_if(group.handlers.begin(), group.handlers.end(),
+                                [i_handler](const tHandler & i_item)
+                                {
+                                  return i_item.get() == i_handler;
+                                });
+      if (found == group.handlers.end())
+      {
+        continue;
+      }
+
+      // Уже переданные группе события обрабатываются до удаления обработчика
+      if (groups_running == true)
+      {
+        StopHandlerGroup(group);
+      }
+
+      group.handlers.erase(found);
+
+      if (group.handlers.empty() == true)
+      {
+        handler_groups.erase(it);
+      }
+      else if (groups_running == true)
+      {
+        StartHandlerGroup(group);
+      }
+      return;
+    }
+  }
+
+  void Logger::StartHandlerGroup(HandlerGroup & io_group)
+  {
+    io_group.active = true;
+    io_group.thread = std::thread(GroupWorker, this, &io_group);
+  }
+
+  void Logger::StopHandlerGroup(HandlerGroup & io_group)
+  {
+    if (io_group.thread.joinable() == false)
+    {
+      return;
+    }
+
+    io_group.active = false;
+    io_group.sem.Notify();
+    io_group.thread.join();
+  }
+
+  void Logger::FanOutEvents(LoggerEvent *i_events, std::size_t i_count)
+  {
+    std::unique_lock<std::mutex> groups_lock(groups_mtx);
+
+    bool render = false;
+    for (const auto & group : handler_groups)
+    {
+      render = render || IsRenderRequired(group->handlers);
+    }
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      if (render == true)
+      {
+        RenderEvent(i_events[i]);
+      }
+      // Группы обрабатывают одну пачку одновременно, кеш строк не используется
+      i_events[i].render_cache.Reset(false);
+    }
+
+    std::shared_ptr<const std::vector<LoggerEvent>> batch = std::make_shared<const std::vector<LoggerEvent>>(
+      std::make_move_iterator(i_events), std::make_move_iterator(i_events + i_count));
+
+    for (auto & group : handler_groups)
+    {
+      group->queue_mtx.lock();
+      if (group->backlog + batch->size() > group->backlog_limit)
+      {
+        group->queue_mtx.unlock();
+        group->dropped += batch->size();
+        continue;
+      }
+
+      group->queue.push_back(batch);
+      group->backlog += batch->size();
+      group->queue_mtx.unlock();
+
+      group->sem.Notify();
+    }
+  }
+
+  Logger::ReturnCode Logger::Log(LoggerEvent::Level i_level, const std::string &i_data)
+  {
+    return Log(nullptr, i_level, i_data);
+  }
+
+  Logger::ReturnCode Logger::Log(const SourceLocation *i_location, LoggerEvent::Level i_level, const std::string &i_data)
+  {
+    if (IsLevelEnabled(i_level) == false)
+    {
+      return RET_SUCCESS;
+    }
+
+    LoggerEvent event;
+    event.level = i_level;
+    event.location = i_location;
+    event.data.assign(i_data.data(), i_data.size());
+    StampEvent(event);
+
+    return DispatchEvent(std::move(event));
+  }
+
+  Logger::ReturnCode Logger::LogFmt(LoggerEvent::Level i_level, const char *i_fmt, ...)
+  {
+    if (IsLevelEnabled(i_level) == false)
+    {
+      return RET_SUCCESS;
+    }
+
+    LoggerEvent event;
+    event.level = i_level;
+
+    va_list vargs;
+    va_start(vargs, i_fmt);
+    event.data.Format(i_fmt, vargs);
+    va_end(vargs);
+
+    StampEvent(event);
+
+    return DispatchEvent(std::move(event));
+  }
+
+  void Logger::StampEvent(LoggerEvent & io_event)
+  {
+    io_event.time_ns = GetTimeNs();
+    io_event.time = static_cast<std::time_t>(io_event.time_ns / 1000000000);
+    io_event.thread_id = t_thread_id;
+    io_event.logger_name = name.load(std::memory_order_relaxed);
+  }
+
+  Logger::ReturnCode Logger::LogDeferred(LoggerEvent && i_event)
+  {
+    StampEvent(i_event);
+
+    return DispatchEvent(std::move(i_event));
+  }
+
+  void Logger::RenderEvent(LoggerEvent & io_event)
+  {
+    if (io_event.format == nullptr)
+    {
+      return;
+    }
+
+    io_event.data.clear();
+    RenderFormat(io_event.format, io_event.args.data(), io_event.args.size(), io_event.data);
+  }
+
+  Logger::ReturnCode Logger::DispatchEvent(LoggerEvent && i_event)
+  {
+    Logger::Mode current_mode = mode;
+
+    // В очередь номер присваивается при помещении, чтобы события в частях очереди были упорядочены
+    if (current_mode == Logger::Mode::ASYNC || current_mode == Logger::Mode::ASYNC_PER_HANDLER)
+    {
+      return EnqueueEvent(std::move(i_event));
+    }
+
+    i_event.sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+
+    if (current_mode == Logger::Mode::SYNC)
+    {
+      RecordDispatch(&i_event, 1);
+      ProcessEvent(i_event);
+    }
+    else if (current_mode == Logger::Mode::ASYNC_BUFFERED)
+    {
+      return StageEvent(std::move(i_event));
+    }
+
+    return RET_SUCCESS;
+  }
+
+  std::string Logger::FormatTimestamp(const char *i_fmt, std::time_t i_ts)
+  {
+    char buffer[128];
+    std::size_t res = FormatTimestamp(buffer, sizeof(buffer), i_fmt, i_ts);
+    if (res != 0)
+    {
+      return std::string(buffer, res);
+    }
+
+    std::tm tm_buf;
+    return FormatTimestamp(i_fmt, localtime_r(&i_ts, &tm_buf));
+  }
+
+  std::string Logger::FormatTimestamp(const char *i_fmt, const std::tm *i_tm)
+  {
+    char stack_buffer[128];
+    std::size_t res = std::strftime(stack_buffer, sizeof(stack_buffer), i_fmt, i_tm);
+    if (res != 0)
+    {
+      return std::string(stack_buffer, res);
+    }
+
+    std::vector<char> buffer(sizeof(stack_buffer) * 2);
+    res = std::strftime(buffer.data(), buffer.size(), i_fmt, i_tm);
+    while (res == 0 && buffer.size() < 4096)
+    {
+      buffer.resize(buffer.size() * 2);
+      res = std::strftime(buffer.data(), buffer.size(), i_fmt, i_tm);
+    }
+    return std::string(buffer.data(), res);
+  }
+
+  std::size_t Logger::FormatTimestamp(char *o_buffer, std::size_t i_size, const char *i_fmt, std::time_t i_ts)
+  {
+    return FormatTimestampNs(o_buffer, i_size, i_fmt, static_cast<std::int64_t>(i_ts) * 1000000000);
+  }
+
+  std::size_t Logger::FormatTimestampNs(char *o_buffer, std::size_t i_size, const char *i_fmt, std::int64_t i_time_ns)
+  {
+    //! Вставка долей секунды в кешированную строку
+    struct Fraction
+    {
+      std::size_t offset;
+      int digits;
+    };
+
+    static const std::size_t MAX_FRACTIONS = 4;
+
+    struct CacheEntry
+    {
+      bool used = false;
+      std::string fmt;
+      std::time_t second = 0;
+      bool valid = false;
+      char rendered[64];
+      std::size_t length = 0;
+      Fraction fractions[MAX_FRACTIONS];
+      std::size_t fraction_count = 0;
+    };
+
+    static const std::size_t CACHE_SIZE = 4;
+    thread_local CacheEntry cache[CACHE_SIZE];
+    thread_local std::size_t next_victim = 0;
+
+    std::time_t second = static_cast<std::time_t>(i_time_ns / 1000000000);
+    std::int64_t nanoseconds = i_time_ns % 1000000000;
+    if (nanoseconds < 0)
+    {
+      nanoseconds += 1000000000;
+      --second;
+    }
+
+    CacheEntry * entry = nullptr;
+    for (auto & candidate : cache)
+    {
+      if (candidate.used == true && std::strcmp(candidate.fmt.c_str(), i_fmt) == 0)
+      {
+        entry = &candidate;
+        break;
+      }
+    }
+
+    if (entry == nullptr)
+    {
+      entry = &cache[next_victim];
+      next_victim = (next_victim + 1) % CACHE_SIZE;
+      entry->used = true;
+      entry->fmt = i_fmt;
+      entry->valid = false;
+    }
+
+    if (entry->valid == false || entry->second != second)
+    {
+      std::tm tm_buf;
+      if (localtime_r(&second, &tm_buf) == nullptr)
+      {
+        return 0;
+      }
+
+      // Формат делится на части по спецификаторам долей секунды, каждая часть форматируется strftime
+      entry->second = second;
+      entry->valid = true;
+      entry->length = 0;
+      entry->fraction_count = 0;
+
+      char part[64];
+      std::size_t part_len = 0;
+      const char * p = i_fmt;
+      for (;;)
+      {
+        std::size_t token_len = 0;
+        int digits = ParseFraction(p, token_len);
+
+        if (digits != 0 || *p == '\0')
+        {
+          part[part_len] = '\0';
+          if (part_len != 0)
+          {
+            std::size_t res = std::strftime(entry->rendered + entry->length,
+                                            sizeof(entry->rendered) - entry->length, part, &tm_buf);
+            if (res == 0)
+            {
+              entry->valid = false;
+              return FormatTimestampUncached(o_buffer, i_size, i_fmt, tm_buf, nanoseconds);
+            }
+            entry->length += res;
+          }
+          part_len = 0;
+
+          if (*p == '\0')
+          {
+            break;
+          }
+
+          if (entry->fraction_count == MAX_FRACTIONS)
+          {
+            entry->valid = false;
+            return FormatTimestampUncached(o_buffer, i_size, i_fmt, tm_buf, nanoseconds);
+          }
+          entry->fractions[entry->fraction_count++] = Fraction{entry->length, digits};
+          p += token_len;
+          continue;
+        }
+
+        if (part_len + 2 >= sizeof(part))
+        {
+          entry->valid = false;
+          return FormatTimestampUncached(o_buffer, i_size, i_fmt, tm_buf, nanoseconds);
+        }
+
+        // %% копируется целиком, чтобы второй символ не был принят за начало спецификатора
+        if (*p == '%' && p[1] == '%')
+        {
+          part[part_len++] = *p++;
+        }
+        part[part_len++] = *p++;
+      }
+    }
+
+    std::size_t total = entry->length;
+    for (std::size_t i = 0; i < entry->fraction_count; ++i)
+    {
+      total += static_cast<std::size_t>(entry->fractions[i].digits);
+    }
+    if (total >= i_size)
+    {
+      return 0;
+    }
+
+    char * out = o_buffer;
+    std::size_t copied = 0;
+    for (std::size_t i = 0; i < entry->fraction_count; ++i)
+    {
+      const Fraction & fraction = entry->fractions[i];
+      std::memcpy(out, entry->rendered + copied, fraction.offset - copied);
+      out += fraction.offset - copied;
+      copied = fraction.offset;
+
+      WriteFraction(out, nanoseconds, fraction.digits);
+      out += fraction.digits;
+    }
+    std::memcpy(out, entry->rendered + copied, entry->length - copied);
+    out += entry->length - copied;
+    *out = '\0';
+
+    return total;
+  }
+
+  std::string Logger::FormatData(const char *i_fmt, ...)
+  {
+    va_list vargs;
+    std::string data;
+    va_start(vargs, i_fmt);
+    data = FormatData(i_fmt, vargs);
+    va_end(vargs);
+    return data;
+  }
+
+  std::string Logger::FormatData(const char *i_fmt, va_list i_args)
+  {
+    EventData data;
+    data.Format(i_fmt, i_args);
+    return std::string(data.data(), data.size());
+  }
+
+  bool Logger::IsRenderRequired(const std::vector<tHandler> &i_handlers)
+  {
+    for (const auto & handler : i_handlers)
+    {
+      if (handler->IsRenderRequired() == true)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  Logger::ReturnCode Logger::ProcessEvent(LoggerEvent & i_event)
+  {
+    return ProcessEvents(&i_event, 1);
+  }
+
+  Logger::ReturnCode Logger::ProcessEvents(LoggerEvent *i_events, std::size_t i_count)
+  {
+    HandlersReader reader(*this);
+
+    if (IsRenderRequired(*reader.list) == true)
+    {
+      for (std::size_t i = 0; i < i_count; ++i)
+      {
+        RenderEvent(i_events[i]);
+      }
+    }
+
+    // Обработчики вызываются последовательно, поэтому строки событий можно разделить между ними
+    bool cache = reader.list->size() > 1;
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      i_events[i].render_cache.Reset(cache);
+    }
+
+    for (const auto & handler : *reader.list)
+    {
+      handler->HandleEvents(i_events, i_count);
+    }
+
+    return RET_SUCCESS;
+  }
+
+  void Logger::FlushHandlers()
+  {
+    HandlersReader reader(*this);
+
+    for (const auto & handler : *reader.list)
+    {
+      handler->FlushIfDue();
+    }
+  }
+
+  Logger::ReturnCode Logger::EnqueueEvent(LoggerEvent && i_event)
+  {
+    ShardSet * set = shard_set.load(std::memory_order_acquire);
+    if (set != nullptr && set->active.load(std::memory_order_acquire) == true)
+    {
+      // Набор мог быть остановлен после проверки, но не освобожден; остановленная часть отмечена stopped
+      QueueShard & shard = *set->shards[t_shard_hint % set->shards.size()];
+      shard.Lock();
+      if (shard.stopped == false)
+      {
+        i_event.sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+        ReturnCode result = PushEvent(shard.queue, shard.sem, &shard, std::move(i_event));
+        shard.Unlock();
+        return result;
+      }
+      shard.Unlock();
+    }
+
+    i_event.sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+    return PushEvent(events_queue, worker_sem, nullptr, std::move(i_event));
+  }
+
+  Logger::ReturnCode Logger::PushEvent(RingBuffer<LoggerEvent> & io_queue, BinarySemaphore & io_sem, QueueShard *d_shard
+                                       , LoggerEvent && i_event)
+  {
+    // Событие попадает в журнал до очереди, иначе поток обработки может снять пометку раньше записи
+    EventJournal * current_journal = journal.load(std::memory_order_acquire);
+    std::uint64_t sequence = i_event.sequence;
+    if (current_journal != nullptr)
+    {
+      current_journal->Write(i_event);
+    }
+
+    std::uint8_t priority = static_cast<std::uint8_t>(i_event.level);
+    bool pushed = io_queue.TryPush(std::move(i_event), priority);
+
+    Logger::OverflowPolicy policy = overflow_policy;
+
+    if (pushed == false && policy == Logger::OverflowPolicy::DROP_NEWEST)
+    {
+      ++dropped_newest;
+      if (current_journal != nullptr)
+      {
+        current_journal->MarkDelivered(sequence);
+      }
+      return ERROR_EVENT_DROPPED;
+    }
+
+    if (pushed == false && policy == Logger::OverflowPolicy::DROP_BELOW_LEVEL && i_event.level < drop_level)
+    {
+      ++dropped_below_level;
+      if (current_journal != nullptr)
+      {
+        current_journal->MarkDelivered(sequence);
+      }
+      return ERROR_EVENT_DROPPED;
+    }
+
+    if (pushed == false && (policy == Logger::OverflowPolicy::DROP_OLDEST || policy == Logger::OverflowPolicy::DROP_BELOW_LEVEL))
+    {
+      // DROP_BELOW_LEVEL вытесняет только события ниже drop_level, остальные ожидают как при BLOCK
+      unsigned victim_limit = policy == Logger::OverflowPolicy::DROP_OLDEST ? UINT8_MAX + 1
+                                                                           : static_cast<unsigned>(drop_level.load());
+      LoggerEvent victim;
+      while (pushed == false)
+      {
+        if (io_queue.TryPopBelow(victim, victim_limit) == true)
+        {
+          ++dropped_oldest;
+          if (d_shard != nullptr)
+          {
+            d_shard->handed.fetch_add(1, std::memory_order_release);
+          }
+          if (current_journal != nullptr)
+          {
+            current_journal->MarkDelivered(victim.sequence);
+          }
+        }
+        else if (io_queue.Size() >= io_queue.Capacity())
+        {
+          break;
+        }
+        pushed = io_queue.TryPush(std::move(i_event), priority);
+      }
+    }
+
+    if (pushed == false)
+    {
+      std::chrono::milliseconds timeout(block_timeout.load());
+      bool unlimited = (timeout == DEFAULT_BLOCK_TIMEOUT);
+      auto deadline = std::chrono::steady_clock::now();
+      if (unlimited == false)
+      {
+        deadline += timeout;
+      }
+
+      while (io_queue.TryPush(std::move(i_event), priority) == false)
+      {
+        if (unlimited == false && std::chrono::steady_clock::now() >= deadline)
+        {
+          ++dropped_timeout;
+          if (current_journal != nullptr)
+          {
+            current_journal->MarkDelivered(sequence);
+          }
+          return ERROR_EVENT_DROPPED;
+        }
+
+        io_sem.Notify();
+        std::this_thread::yield();
+      }
+    }
+
+    if (d_shard != nullptr)
+    {
+      d_shard->pushed.fetch_add(1, std::memory_order_relaxed);
+    }
+    io_sem.Notify();
+    return RET_SUCCESS;
+  }
+
+  Logger::ReturnCode Logger::StageEvent(LoggerEvent && i_event)
+  {
+    StagingBuffer & buffer = GetStagingBuffer();
+    ReturnCode result = RET_SUCCESS;
+
+    std::vector<LoggerEvent> batch;
+
+    buffer.Lock();
+    buffer.events.push_back(std::move(i_event));
+    if (buffer.events.size() >= staging_capacity)
+    {
+      batch.swap(buffer.events);
+    }
+    buffer.Unlock();
+
+    if (batch.empty() == true)
+    {
+      return result;
+    }
+
+    // Передача выполняется без блокировки буфера, чтобы поток обработки мог забирать его по таймеру
+    result = PublishBatch(batch);
+
+    buffer.Lock();
+    if (buffer.events.capacity() < batch.capacity())
+    {
+      batch.insert(batch.end(), std::make_move_iterator(buffer.events.begin()),
+                   std::make_move_iterator(buffer.events.end()));
+      buffer.events.swap(batch);
+    }
+    buffer.Unlock();
+
+    return result;
+  }
+
+  Logger::StagingBuffer & Logger::GetStagingBuffer()
+  {
+    for (auto it = t_staging_buffers.begin(); it != t_staging_buffers.end(); ++it)
+    {
+      if (it->first == instance_id)
+      {
+        return *static_cast<StagingBuffer *>(it->second.get());
+      }
+    }
+
+    // Буферы уничтоженных логгеров больше не нужны
+    t_staging_buffers.erase(std::remove_if(t_staging_buffers.begin(), t_staging_buffers.end(),
+                                           [](const std::pair<std::uint64_t, std::shared_ptr<void>> & i_entry)
+                                           {
+                                             return static_cast<StagingBuffer *>(i_entry.second.get())->orphaned == true;
+                                           }), t_staging_buffers.end());
+
+    auto buffer = std::make_shared<StagingBuffer>();
+    buffer->events.reserve(staging_capacity);
+
+    staging_mtx.lock();
+    staging_buffers.push_back(buffer);
+    staging_mtx.unlock();
+
+    t_staging_buffers.emplace_back(instance_id, buffer);
+    return *buffer;
+  }
+
+  Logger::ReturnCode Logger::PublishBatch(std::vector<LoggerEvent> & io_batch)
+  {
+    ReturnCode result = RET_SUCCESS;
+    const std::size_t capacity = events_queue.Capacity();
+
+    std::unique_lock<std::mutex> lock(batches_mtx);
+
+    // Политика применяется к каждому событию пачки так же, как в PushEvent
+    if (published_count + io_batch.size() > capacity)
+    {
+      Logger::OverflowPolicy policy = overflow_policy;
+
+      if (policy == Logger::OverflowPolicy::DROP_NEWEST)
+      {
+        dropped_newest += io_batch.size();
+        io_batch.clear();
+        return ERROR_EVENT_DROPPED;
+      }
+
+      if (policy == Logger::OverflowPolicy::DROP_BELOW_LEVEL)
+      {
+        LoggerEvent::Level level = drop_level;
+        std::size_t kept = 0;
+        for (std::size_t i = 0; i < io_batch.size(); ++i)
+        {
+          if (io_batch[i].level >= level)
+          {
+            if (kept != i)
+            {
+              io_batch[kept] = std::move(io_batch[i]);
+            }
+            ++kept;
+          }
+        }
+
+        if (kept != io_batch.size())
+        {
+          dropped_below_level += io_batch.size() - kept;
+          io_batch.resize(kept);
+          result = ERROR_EVENT_DROPPED;
+        }
+      }
+
+      if (published_count + io_batch.size() > capacity
+          && (policy == Logger::OverflowPolicy::DROP_OLDEST || policy == Logger::OverflowPolicy::DROP_BELOW_LEVEL))
+      {
+        // DROP_BELOW_LEVEL вытесняет только события ниже drop_level, остальные ожидают как при BLOCK
+        unsigned victim_limit = policy == Logger::OverflowPolicy::DROP_OLDEST ? UINT8_MAX + 1
+                                                                             : static_cast<unsigned>(drop_level.load());
+        dropped_oldest += EvictPublished(published_count + io_batch.size() - capacity, victim_limit);
+      }
+
+      if (io_batch.empty() == true)
+      {
+        return result;
+      }
+
+      std::chrono::milliseconds timeout(block_timeout.load());
+      bool unlimited = (timeout == DEFAULT_BLOCK_TIMEOUT);
+      auto deadline = std::chrono::steady_clock::now() + (unlimited ? std::chrono::milliseconds(0) : timeout);
+
+      while (published_count + io_batch.size() > capacity && published_count > 0)
+      {
+        if (unlimited == false && std::chrono::steady_clock::now() >= deadline)
+        {
+          dropped_timeout += io_batch.size();
+          io_batch.clear();
+          return ERROR_EVENT_DROPPED;
+        }
+
+        // Производитель засыпает до обработки переданных пачек, DrainStagingBuffers будит его через published_cv
+        worker_sem.Notify();
+        if (unlimited == true)
+        {
+          published_cv.wait(lock);
+        }
+        else
+        {
+          published_cv.wait_until(lock, deadline);
+        }
+      }
+    }
+
+    published_count += io_batch.size();
+    published_batches.push_back(std::move(io_batch));
+    if (spare_batches.empty() == false)
+    {
+      io_batch = std::move(spare_batches.back());
+      spare_batches.pop_back();
+    }
+    else
+    {
+      io_batch = std::vector<LoggerEvent>();
+    }
+    lock.unlock();
 
+    worker_sem.Notify();
+    return result;
   }
 
-  void BinarySemaphore::Notify()
+  std::size_t Logger::EvictPublished(std::size_t i_count, unsigned i_limit)
   {
-    std::unique_lock<std::mutex> lck(mtx);
-    notified = true;
-    cv.notify_one();
+    std::size_t evicted = 0;
+    for (auto & batch : published_batches)
+    {
+      std::size_t kept = 0;
+      for (std::size_t i = 0; i < batch.size(); ++i)
+      {
+        if (evicted < i_count && static_cast<unsigned>(batch[i].level) < i_limit)
+        {
+          ++evicted;
+          continue;
+        }
+        if (kept != i)
+        {
+          batch[kept] = std::move(batch[i]);
+        }
+        ++kept;
+      }
+      batch.resize(kept);
+
+      if (evicted == i_count)
+      {
+        break;
+      }
+    }
+
+    published_count -= evicted;
+    return evicted;
   }
 
-  void BinarySemaphore::Wait()
+  void Logger::DrainQueue()
   {
-    std::unique_lock<std::mutex> lck(mtx);
-    while (notified == false)
+    if (drain_batch.size() < DEFAULT_BATCH_SIZE)
     {
-      cv.wait(lck);
+      drain_batch.resize(DEFAULT_BATCH_SIZE);
     }
 
-    notified = false;
+    for (;;)
+    {
+      std::size_t count = 0;
+      while (count < drain_batch.size() && events_queue.TryPop(drain_batch[count]) == true)
+      {
+        ++count;
+      }
+
+      if (count == 0)
+      {
+        return;
+      }
+
+      UpdateQueueHighWater(count + events_queue.Size());
+      RecordDispatch(drain_batch.data(), count);
+
+      if (mode == Logger::Mode::ASYNC_PER_HANDLER)
+      {
+        FanOutEvents(drain_batch.data(), count);
+      }
+      else
+      {
+        ProcessEvents(drain_batch.data(), count);
+      }
+
+      EventJournal * current_journal = journal.load(std::memory_order_acquire);
+      if (current_journal != nullptr)
+      {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+          current_journal->MarkDelivered(drain_batch[i].sequence);
+        }
+      }
+    }
   }
 
-  int HandlerInterface::HandleEvent(const LoggerEvent &i_event)
+  void Logger::DrainStagingBuffers()
   {
-    if (flag_enabled == false)
+    std::vector<std::vector<LoggerEvent>> batches;
+
+    batches_mtx.lock();
+    batches.swap(published_batches);
+    batches_mtx.unlock();
+
+    std::size_t published = 0;
+    for (auto & batch : batches)
     {
-      return 0;
+      published += batch.size();
     }
 
-    if (log_level > i_event.level)
+    std::vector<std::shared_ptr<StagingBuffer>> buffers;
+    staging_mtx.lock();
+    buffers = staging_buffers;
+    staging_mtx.unlock();
+
+    for (auto & buffer : buffers)
     {
-      return 0;
+      std::vector<LoggerEvent> batch;
+      buffer->Lock();
+      if (buffer->events.empty() == false)
+      {
+        batch.reserve(buffer->events.capacity());
+        batch.swap(buffer->events);
+      }
+      buffer->Unlock();
+
+      if (batch.empty() == false)
+      {
+        batches.push_back(std::move(batch));
+      }
     }
+    buffers.clear();
 
-    return HandlerFunction(i_event);
-  }
+    // Ссылку на буфер держит thread_local владельца, при завершении потока остается только ссылка логгера
+    staging_mtx.lock();
+    staging_buffers.erase(std::remove_if(staging_buffers.begin(), staging_buffers.end(),
+                                         [](const std::shared_ptr<StagingBuffer> & i_buffer)
+                                         {
+                                           if (i_buffer.use_count() != 1)
+                                           {
+                                             return false;
+                                           }
+                                           i_buffer->Lock();
+                                           bool empty = i_buffer->events.empty();
+                                           i_buffer->Unlock();
+                                           return empty;
+                                         }), staging_buffers.end());
+    staging_mtx.unlock();
 
-  LoggerEvent::Level HandlerInterface::GetLogLevel() const
-  {
-    return log_level;
-  }
+    if (batches.empty() == true)
+    {
+      return;
+    }
 
-  void HandlerInterface::SetLogLevel(LoggerEvent::Level i_level)
-  {
-    log_level = i_level;
-  }
+    std::vector<LoggerEvent> merged;
+    std::size_t total = 0;
+    for (auto & batch : batches)
+    {
+      total += batch.size();
+    }
+    merged.reserve(total);
 
-  bool HandlerInterface::IsEnabled() const
-  {
-    return flag_enabled;
-  }
+    for (auto & batch : batches)
+    {
+      std::move(batch.begin(), batch.end(), std::back_inserter(merged));
+    }
 
-  void HandlerInterface::Enable()
-  {
-    flag_enabled = true;
-  }
+    std::sort(merged.begin(), merged.end(),
+              [](const LoggerEvent & i_lhs, const LoggerEvent & i_rhs)
+              {
+                return i_lhs.sequence < i_rhs.sequence;
+              });
 
-  void HandlerInterface::Disable()
-  {
-    flag_enabled = false;
-  }
+    RecordDispatch(merged.data(), merged.size());
+    ProcessEvents(merged.data(), merged.size());
 
-  Logger::Logger(const Logger::Mode & i_mode)
-    : worker_active(false)
-  {
-    SetMode(i_mode);
-  }
+    batches_mtx.lock();
+    published_count -= published;
+    for (auto & batch : batches)
+    {
+      batch.clear();
+      spare_batches.push_back(std::move(batch));
+    }
+    batches_mtx.unlock();
 
-  Logger::~Logger()
-  {
-    SetMode(Logger::Mode::DISABLED);
+    published_cv.notify_all();
   }
 
-  Logger::Mode Logger::GetMode() const
+  void Logger::StartShards()
   {
-    return mode;
+    std::size_t count = worker_count;
+    if (count <= 1)
+    {
+      return;
+    }
+
+    // Наборы не освобождаются до удаления логгера: производитель мог получить указатель до остановки набора
+    ShardSet * set = nullptr;
+    for (auto & candidate : shard_sets)
+    {
+      if (candidate->shards.size() == count)
+      {
+        set = candidate.get();
+        break;
+      }
+    }
+
+    if (set == nullptr)
+    {
+      shard_sets.emplace_back(new ShardSet());
+      set = shard_sets.back().get();
+      std::size_t capacity = std::max(events_queue.Capacity() / count, static_cast<std::size_t>(DEFAULT_BATCH_SIZE));
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        set->shards.emplace_back(new QueueShard(capacity));
+      }
+    }
+
+    for (auto & shard : set->shards)
+    {
+      shard->Lock();
+      shard->stopped = false;
+      shard->Unlock();
+
+      shard->active = true;
+      shard->thread = std::thread(ShardWorker, this, shard.get());
+    }
+
+    set->active.store(true, std::memory_order_release);
+    shard_set.store(set, std::memory_order_release);
   }
 
-  void Logger::SetMode(const Logger::Mode &i_mode)
+  void Logger::StopShards()
   {
-    if (mode == i_mode)
+    ShardSet * set = shard_set.load(std::memory_order_acquire);
+    if (set == nullptr || set->active.load() == false)
     {
       return;
     }
 
-    if (i_mode == Logger::Mode::ASYNC && mode != Logger::Mode::ASYNC)
+    // Новые события попадают в events_queue. Производитель, успевший выбрать часть, проверяет stopped под ее блокировкой
+    set->active.store(false, std::memory_order_release);
+    for (auto & shard : set->shards)
     {
-      worker_active = true;
-      worker_thread = std::thread(QueueWorker, this);
+      shard->Lock();
+      shard->stopped = true;
+      shard->Unlock();
     }
-    else if (i_mode != Logger::Mode::ASYNC && mode == Logger::Mode::ASYNC)
+
+    for (auto & shard : set->shards)
     {
-      worker_active = false;
-      worker_sem.Notify();
-      worker_thread.join();
+      shard->active = false;
+      shard->sem.Notify();
+      shard->thread.join();
+    }
 
-      while (events_queue.empty() == false)
+    for (auto & shard : set->shards)
+    {
+      while (DrainShard(*shard, false) == true)
       {
-        ProcessEvent(events_queue.front());
-        events_queue.pop();
       }
     }
-    mode = i_mode;
   }
 
-  std::size_t Logger::GetHandlersCount()
+  bool Logger::DrainShard(QueueShard & io_shard, bool i_wait)
   {
-    std::unique_lock<std::mutex> handlers_lock(handlers_mtx);
+    std::vector<LoggerEvent> & batch = io_shard.drain_batch;
+    batch.resize(DEFAULT_BATCH_SIZE);
 
-    return handlers.size();
-  }
+    std::size_t count = 0;
+    while (count < batch.size() && io_shard.queue.TryPop(batch[count]) == true)
+    {
+      ++count;
+    }
 
-  tHandler Logger::GetHandlerByIndex(std::size_t i_index)
-  {
-    std::unique_lock<std::mutex> handlers_lock(handlers_mtx);
+    if (count == 0)
+    {
+      return false;
+    }
+    batch.resize(count);
+    UpdateQueueHighWater(count + io_shard.queue.Size());
 
-    if (i_index < handlers.size())
+    MergeBatch merge;
     {
-      std::size_t count = 0;
-      for (auto it = handlers.begin(); it != handlers.end(); ++it, ++count)
+      HandlersReader reader(*this);
+
+      // Формирование текста выполняется параллельно во всех потоках частей
+      if (IsRenderRequired(*reader.list) == true)
+      {
+        for (auto & event : batch)
+        {
+          RenderEvent(event);
+        }
+        merge.rendered = true;
+      }
+
+      // Строки, сформированные обработчиками без порядка, используются и на этапе слияния
+      bool cache = reader.list->size() > 1;
+      for (auto & event : batch)
       {
-        if (count == i_index)
+        event.render_cache.Reset(cache);
+      }
+
+      for (const auto & handler : *reader.list)
+      {
+        if (handler->IsOrderRequired() == false)
         {
-          return *it;
+          handler->HandleEvents(batch.data(), count);
         }
       }
     }
 
-    return tHandler();
-  }
+    // Этап слияния не должен накапливать больше событий, чем вмещает очередь
+    while (i_wait == true && merge_count > 0 && merge_count + count > events_queue.Capacity())
+    {
+      worker_sem.Notify();
+      std::this_thread::yield();
+    }
 
-  Logger::ReturnCode Logger::AddHandler(const tHandler & i_handler)
-  {
-    std::unique_lock<std::mutex> handlers_lock(handlers_mtx);
+    std::uint64_t last_sequence = batch.back().sequence;
+    merge.events = std::move(batch);
 
-    for (const auto & handler : handlers)
+    merge_mtx.lock();
+    merge_batches.push_back(std::move(merge));
+    merge_count += count;
+    if (merge_spare.empty() == false)
     {
-      if (i_handler.get() == handler.get())
-      {
-        return ERROR_HANDLER_NOT_UNIQUE;
-      }
+      batch = std::move(merge_spare.back());
+      merge_spare.pop_back();
+    }
+    else
+    {
+      batch = std::vector<LoggerEvent>();
     }
+    merge_mtx.unlock();
 
-    handlers.push_back(i_handler);
-    return RET_SUCCESS;
+    // Остальные события части имеют большие номера, так как помещаются в queue по возрастанию номеров
+    io_shard.bound.store(last_sequence + 1, std::memory_order_release);
+    io_shard.handed.fetch_add(count, std::memory_order_release);
+
+    worker_sem.Notify();
+    return true;
   }
 
-  Logger::ReturnCode Logger::DelHandler(const tHandler & i_handler)
+  std::uint64_t Logger::GetMergeWatermark()
   {
-    std::unique_lock<std::mutex> handlers_lock(handlers_mtx);
+    ShardSet * set = shard_set.load(std::memory_order_acquire);
+    if (set == nullptr)
+    {
+      return UINT64_MAX;
+    }
 
-    for (auto it = handlers.begin(); it != handlers.end(); ++it)
+    std::uint64_t watermark = UINT64_MAX;
+    for (auto & shard : set->shards)
     {
-      if (i_handler.get() == (*it).get())
+      std::uint64_t bound = shard->bound.load(std::memory_order_acquire);
+      // Если все события части переданы, новые события получат номера не меньше next_sequence.
+      // Занятая производителем часть оценивается по последней переданной пачке
+      if (shard->TryLock() == true)
       {
-        handlers.erase(it);
-        return RET_SUCCESS;
+        if (shard->handed.load(std::memory_order_acquire) == shard->pushed.load(std::memory_order_relaxed))
+        {
+          bound = next_sequence.load(std::memory_order_relaxed);
+        }
+        shard->Unlock();
       }
+      watermark = std::min(watermark, bound);
     }
 
-    return ERROR_HANDLER_NOT_FOUND;
+    return watermark;
   }
 
-  Logger::ReturnCode Logger::DelHandlerByIndex(std::size_t i_index)
+  void Logger::DrainMergeBatches()
   {
-    std::unique_lock<std::mutex> handlers_lock(handlers_mtx);
+    // Граница определяется до извлечения пачек: все события с меньшими номерами уже находятся в merge_batches
+    std::uint64_t watermark = GetMergeWatermark();
+
+    std::vector<MergeBatch> batches;
+
+    merge_mtx.lock();
+    batches.swap(merge_batches);
+    merge_mtx.unlock();
 
-    if (i_index >= handlers.size())
+    if (batches.empty() == true && merge_held.empty() == true)
     {
-      return ERROR_HANDLER_NOT_FOUND;
+      return;
     }
 
-    std::size_t count = 0;
+    HandlersReader reader(*this);
+    bool render = IsRenderRequired(*reader.list);
 
-    for (auto it = handlers.begin(); it != handlers.end(); ++it, ++count)
+    std::size_t total = 0;
+    for (auto & batch : batches)
     {
-      if (count == i_index)
+      total += batch.events.size();
+
+      // Обработчик, которому нужен текст, мог быть добавлен после формирования пачки
+      if (render == true && batch.rendered == false)
       {
-        handlers.erase(it);
-        return RET_SUCCESS;
+        for (auto & event : batch.events)
+        {
+          RenderEvent(event);
+          event.render_cache.Reset(event.render_cache.enabled);
+        }
       }
     }
 
-    return RET_SUCCESS;
-  }
-
-  Logger::ReturnCode Logger::Log(LoggerEvent::Level i_level, const std::string &i_data)
-  {
-    LoggerEvent event;
-    event.level = i_level;
-    event.data = i_data;
-    event.time = std::time(nullptr);
-
-    if (mode == Logger::Mode::SYNC)
+    // События, отложенные на прошлом шаге, уже сформированы
+    merge_held.reserve(merge_held.size() + total);
+    for (auto & batch : batches)
     {
-      ProcessEvent(event);
+      std::move(batch.events.begin(), batch.events.end(), std::back_inserter(merge_held));
     }
-    else if (mode == Logger::Mode::ASYNC)
-    {
-      queue_mtx.lock();
-      events_queue.push(event);
-      queue_mtx.unlock();
 
-      worker_sem.Notify();
-    }
+    std::sort(merge_held.begin(), merge_held.end(),
+              [](const LoggerEvent & i_lhs, const LoggerEvent & i_rhs)
+              {
+                return i_lhs.sequence < i_rhs.sequence;
+              });
 
-    return RET_SUCCESS;
-  }
+    // События с номерами от границы откладываются: часть может еще передать событие с меньшим номером
+    std::size_t ready = static_cast<std::size_t>(
+      std::partition_point(merge_held.begin(), merge_held.end(),
+                           [watermark](const LoggerEvent & i_event)
+                           {
+                             return i_event.sequence < watermark;
+                           }) - merge_held.begin());
 
-  Logger::ReturnCode Logger::LogFmt(LoggerEvent::Level i_level, const char *i_fmt, ...)
-  {
-    va_list vargs;
-    std::string data;
-    va_start(vargs, i_fmt);
-    data = FormatData(i_fmt, vargs);
-    va_end(vargs);
+    if (ready != 0)
+    {
+      RecordDispatch(merge_held.data(), ready);
 
-    return this->Log(i_level, data);
-  }
+      for (const auto & handler : *reader.list)
+      {
+        if (handler->IsOrderRequired() == true)
+        {
+          handler->HandleEvents(merge_held.data(), ready);
+        }
+      }
 
-  std::string Logger::FormatTimestamp(const char *i_fmt, std::time_t i_ts)
-  {
-    return FormatTimestamp(i_fmt, localtime(&i_ts));
-  }
+      EventJournal * current_journal = journal.load(std::memory_order_acquire);
+      if (current_journal != nullptr)
+      {
+        for (std::size_t i = 0; i < ready; ++i)
+        {
+          current_journal->MarkDelivered(merge_held[i].sequence);
+        }
+      }
 
-  std::string Logger::FormatTimestamp(const char *i_fmt, const std::tm *i_tm)
-  {
-    std::vector<char> buffer(64);
-    std::size_t res;
-    res = std::strftime(buffer.data(), buffer.size(), i_fmt, i_tm);
-    while (res == 0)
+      merge_held.erase(merge_held.begin(), merge_held.begin() + static_cast<std::ptrdiff_t>(ready));
+    }
+
+    merge_count -= total;
+    merge_held_count.store(merge_held.size(), std::memory_order_relaxed);
+
+    merge_mtx.lock();
+    for (auto & batch : batches)
     {
-      buffer.resize(buffer.size() * 2);
-      res = std::strftime(buffer.data(), buffer.size(), i_fmt, i_tm);
+      batch.events.clear();
+      merge_spare.push_back(std::move(batch.events));
     }
-    buffer[res] = '\0';
-    return std::string(buffer.data());
+    merge_mtx.unlock();
   }
 
-  std::string Logger::FormatData(const char *i_fmt, ...)
+  bool Logger::IsAsyncMode(Logger::Mode i_mode)
   {
-    va_list vargs;
-    std::string data;
-    va_start(vargs, i_fmt);
-    data = FormatData(i_fmt, vargs);
-    va_end(vargs);
-    return data;
+    return i_mode == Logger::Mode::ASYNC || i_mode == Logger::Mode::ASYNC_BUFFERED
+           || i_mode == Logger::Mode::ASYNC_PER_HANDLER;
   }
 
-  std::string Logger::FormatData(const char *i_fmt, va_list i_args)
+  void Logger::QueueWorker(Logger *d_logger)
   {
-    std::vector<char> buffer(1024);
-    va_list tesm_args;
-    va_copy(tesm_args, i_args);
-
-    int res = vsnprintf(buffer.data(), buffer.size(), i_fmt, tesm_args);
-    if (res < 0)
+    while (d_logger->worker_active == true)
     {
-      return std::string();
-    }
+      d_logger->worker_sem.WaitFor(d_logger->GetWorkerSleep());
 
-    if ((res >= 0) && (res < static_cast<int>(buffer.size())))
-    {
-      va_end(tesm_args);
-      return std::string(buffer.data());
-    }
+      if (d_logger->mode == Logger::Mode::ASYNC_BUFFERED)
+      {
+        d_logger->DrainStagingBuffers();
+      }
 
-    buffer.resize(static_cast<size_t>(res) + 1);
-    res = vsnprintf(buffer.data(), buffer.size(), i_fmt, tesm_args);
-    va_end(tesm_args);
+      if (d_logger->merge_count > 0 || d_logger->merge_held_count > 0)
+      {
+        d_logger->DrainMergeBatches();
+      }
 
-    if ((res >= 0) && (res < static_cast<int>(buffer.size())))
-    {
-      return std::string(buffer.data());
+      d_logger->DrainQueue();
+
+      // В режиме ASYNC_PER_HANDLER сброс выполняют потоки групп
+      if (d_logger->mode != Logger::Mode::ASYNC_PER_HANDLER)
+      {
+        d_logger->FlushHandlers();
+      }
     }
-    return std::string();
   }
 
-  Logger::ReturnCode Logger::ProcessEvent(const LoggerEvent & i_event)
+  void Logger::ShardWorker(Logger *d_logger, QueueShard *d_shard)
   {
-    std::unique_lock<std::mutex> handlers_lock(handlers_mtx);
-
-    for (auto & handler : this->handlers)
+    while (d_shard->active == true)
     {
-      handler->HandleEvent(i_event);
-    }
+      d_shard->sem.WaitFor(d_logger->GetWorkerSleep());
 
-    return RET_SUCCESS;
+      while (d_logger->DrainShard(*d_shard, true) == true)
+      {
+      }
+    }
   }
 
-  void Logger::QueueWorker(Logger *d_logger)
+  void Logger::GroupWorker(Logger *d_logger, HandlerGroup *d_group)
   {
-    while (d_logger->worker_active == true)
+    for (;;)
     {
-      d_logger->worker_sem.Wait();
-
-      LoggerEvent temp_event;
+      d_group->sem.WaitFor(d_logger->GetWorkerSleep());
+      bool stopping = d_group->active == false;
 
-      d_logger->queue_mtx.lock();
-      while (d_logger->events_queue.empty() == false)
+      for (;;)
       {
-        temp_event = d_logger->events_queue.front();
-        d_logger->events_queue.pop();
+        std::shared_ptr<const std::vector<LoggerEvent>> batch;
+        d_group->queue_mtx.lock();
+        if (d_group->queue.empty() == false)
+        {
+          batch = std::move(d_group->queue.front());
+          d_group->queue.pop_front();
+        }
+        d_group->queue_mtx.unlock();
+
+        if (batch == nullptr)
+        {
+          break;
+        }
+
+        for (const auto & handler : d_group->handlers)
+        {
+          handler->HandleEvents(batch->data(), batch->size());
+        }
 
-        d_logger->queue_mtx.unlock();
+        d_group->queue_mtx.lock();
+        d_group->backlog -= batch->size();
+        d_group->queue_mtx.unlock();
+      }
 
-        d_logger->ProcessEvent(temp_event);
+      for (const auto & handler : d_group->handlers)
+      {
+        handler->FlushIfDue();
+      }
 
-        d_logger->queue_mtx.lock();
+      if (stopping == true)
+      {
+        return;
       }
-      d_logger->queue_mtx.unlock();
     }
   }
 }
@@ -0,0 +1,363 @@
+#include "logger_binary_handler.hpp"
+
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace slx
+{
+  namespace
+  {
+    //! Размер данных записи, больше которого файл считается поврежденным
+    const std::uint64_t MAX_RECORD_SIZE = 1u << 30;
+
+    void AppendVarint(std::string &o_buffer, std::uint64_t i_value)
+    {
+      char bytes[10];
+      std::size_t size = 0;
+      while (i_value >= 0x80)
+      {
+        bytes[size++] = static_cast<char>((i_value & 0x7f) | 0x80);
+        i_value >>= 7;
+      }
+      bytes[size++] = static_cast<char>(i_value);
+      o_buffer.append(bytes, size);
+    }
+
+    std::uint64_t ZigZag(std::int64_t i_value)
+    {
+      return (static_cast<std::uint64_t>(i_value) << 1) ^ static_cast<std::uint64_t>(i_value >> 63);
+    }
+
+    std::int64_t UnZigZag(std::uint64_t i_value)
+    {
+      return static_cast<std::int64_t>(i_value >> 1) ^ -static_cast<std::int64_t>(i_value & 1);
+    }
+  }
+
+  HandlerBinaryFile::HandlerBinaryFile(const std::string &i_filename)
+    : HandlerInterface(), next_format_id(1), next_location_id(1), last_time_ns(0), last_sequence(0)
+  {
+    struct stat st;
+    bool empty = stat(i_filename.c_str(), &st) != 0 || st.st_size == 0;
+
+    file.open(i_filename, std::ios_base::app | std::ios_base::binary);
+    if (file.is_open() == false)
+    {
+      return;
+    }
+
+    if (empty == true)
+    {
+      file.write(binary_log::MAGIC, sizeof(binary_log::MAGIC));
+    }
+    file.put(static_cast<char>(binary_log::RECORD_SESSION));
+  }
+
+  bool HandlerBinaryFile::IsOpen() const
+  {
+    return file.is_open();
+  }
+
+  bool HandlerBinaryFile::IsRenderRequired() const
+  {
+    return false;
+  }
+
+  int HandlerBinaryFile::HandlerFunction(const LoggerEvent &i_event)
+  {
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerBinaryFile::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    if (file.is_open() == false)
+    {
+      return 1;
+    }
+
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      AppendEvent(*i_events[i]);
+    }
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    if (FlushRequired(i_events, i_count) == true)
+    {
+      file.flush();
+    }
+
+    return 0;
+  }
+
+  void HandlerBinaryFile::FlushFunction()
+  {
+    file.flush();
+  }
+
+  void HandlerBinaryFile::AppendEvent(const LoggerEvent &i_event)
+  {
+    std::uint64_t format_id = binary_log::NO_FORMAT;
+    if (i_event.format != nullptr)
+    {
+      auto it = format_ids.find(i_event.format);
+      if (it != format_ids.end())
+      {
+        format_id = it->second;
+      }
+      else
+      {
+        format_id = next_format_id++;
+        format_ids.emplace(i_event.format, format_id);
+
+        std::size_t size = std::strlen(i_event.format);
+        buffer += static_cast<char>(binary_log::RECORD_FORMAT);
+        AppendVarint(buffer, format_id);
+        AppendVarint(buffer, size);
+        buffer.append(i_event.format, size);
+      }
+    }
+
+    std::uint64_t location_id = 0;
+    if (i_event.location != nullptr)
+    {
+      auto it = location_ids.find(i_event.location);
+      if (it != location_ids.end())
+      {
+        location_id = it->second;
+      }
+      else
+      {
+        location_id = next_location_id++;
+        location_ids.emplace(i_event.location, location_id);
+
+        std::size_t file_size = std::strlen(i_event.location->file);
+        std::size_t function_size = std::strlen(i_event.location->function);
+        buffer += static_cast<char>(binary_log::RECORD_LOCATION);
+        AppendVarint(buffer, location_id);
+        AppendVarint(buffer, i_event.location->line);
+        AppendVarint(buffer, file_size);
+        buffer.append(i_event.location->file, file_size);
+        AppendVarint(buffer, function_size);
+        buffer.append(i_event.location->function, function_size);
+      }
+    }
+
+    const EventData & payload = format_id != binary_log::NO_FORMAT ? i_event.args : i_event.data;
+    std::int64_t time_ns = i_event.time_ns != 0 ? i_event.time_ns : static_cast<std::int64_t>(i_event.time) * 1000000000;
+
+    std::uint8_t type = binary_log::RECORD_EVENT | static_cast<std::uint8_t>(i_event.level);
+    if (location_id != 0)
+    {
+      type |= binary_log::EVENT_HAS_LOCATION;
+    }
+    buffer += static_cast<char>(type);
+    AppendVarint(buffer, ZigZag(time_ns - last_time_ns));
+    AppendVarint(buffer, ZigZag(static_cast<std::int64_t>(i_event.sequence - last_sequence)));
+    AppendVarint(buffer, format_id);
+    if (location_id != 0)
+    {
+      AppendVarint(buffer, location_id);
+    }
+    AppendVarint(buffer, payload.size());
+    AppendVarint(buffer, i_event.fields.size());
+    buffer.append(payload.data(), payload.size());
+    buffer.append(i_event.fields.data(), i_event.fields.size());
+
+    last_time_ns = time_ns;
+    last_sequence = i_event.sequence;
+  }
+
+  BinaryLogReader::BinaryLogReader(const std::string &i_filename)
+    : file(i_filename, std::ios_base::in | std::ios_base::binary), valid(false), corrupted(false)
+    , last_time_ns(0), last_sequence(0)
+  {
+    char magic[sizeof(binary_log::MAGIC)];
+    if (Read(magic, sizeof(magic)) == true && std::memcmp(magic, binary_log::MAGIC, sizeof(magic)) == 0)
+    {
+      valid = true;
+    }
+  }
+
+  bool BinaryLogReader::IsOpen() const
+  {
+    return valid;
+  }
+
+  bool BinaryLogReader::IsCorrupted() const
+  {
+    return corrupted;
+  }
+
+  bool BinaryLogReader::Read(void *o_data, std::size_t i_size)
+  {
+    file.read(static_cast<char *>(o_data), static_cast<std::streamsize>(i_size));
+    return static_cast<std::size_t>(file.gcount()) == i_size;
+  }
+
+  bool BinaryLogReader::ReadVarint(std::uint64_t &o_value)
+  {
+    o_value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+      std::uint8_t byte;
+      if (Read(&byte, 1) == false)
+      {
+        return false;
+      }
+
+      o_value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool BinaryLogReader::ReadString(std::string &o_string)
+  {
+    std::uint64_t size = 0;
+    if (ReadVarint(size) == false || size > MAX_RECORD_SIZE)
+    {
+      return false;
+    }
+
+    o_string.resize(size);
+    return size == 0 || Read(&o_string[0], o_string.size()) == true;
+  }
+
+  bool BinaryLogReader::ReadEvent(LoggerEvent &o_event)
+  {
+    if (valid == false)
+    {
+      return false;
+    }
+
+    for (;;)
+    {
+      std::uint8_t type;
+      if (Read(&type, 1) == false)
+      {
+        return false;
+      }
+
+      if (type == binary_log::RECORD_SESSION)
+      {
+        formats.clear();
+        locations.clear();
+        last_time_ns = 0;
+        last_sequence = 0;
+        continue;
+      }
+
+      if (type == binary_log::RECORD_FORMAT)
+      {
+        std::uint64_t id = 0;
+        std::uint64_t size = 0;
+        if (ReadVarint(id) == false || ReadVarint(size) == false || size > MAX_RECORD_SIZE)
+        {
+          corrupted = true;
+          return false;
+        }
+
+        std::string & format = formats[id];
+        format.resize(size);
+        if (Read(&format[0], format.size()) == false)
+        {
+          corrupted = true;
+          return false;
+        }
+        continue;
+      }
+
+      if (type == binary_log::RECORD_LOCATION)
+      {
+        std::uint64_t id = 0;
+        std::uint64_t line = 0;
+        LocationRecord record;
+        if (ReadVarint(id) == false || ReadVarint(line) == false
+            || ReadString(record.file) == false || ReadString(record.function) == false)
+        {
+          corrupted = true;
+          return false;
+        }
+
+        location_records.push_back(std::move(record));
+        LocationRecord & stored = location_records.back();
+        stored.location = SourceLocation{stored.file.c_str(), stored.function.c_str(), static_cast<std::uint32_t>(line)};
+        locations[id] = &stored.location;
+        continue;
+      }
+
+      bool has_location = (type & binary_log::RECORD_EVENT) != 0 && (type & binary_log::EVENT_HAS_LOCATION) != 0;
+      std::uint8_t level = type & ~(binary_log::RECORD_EVENT | binary_log::EVENT_HAS_LOCATION);
+      std::uint64_t time_delta = 0;
+      std::uint64_t sequence_delta = 0;
+      std::uint64_t format_id = 0;
+      std::uint64_t location_id = 0;
+      std::uint64_t payload_size = 0;
+      std::uint64_t fields_size = 0;
+      if ((type & binary_log::RECORD_EVENT) == 0 || level > static_cast<std::uint8_t>(LoggerEvent::Level::FATAL)
+          || ReadVarint(time_delta) == false || ReadVarint(sequence_delta) == false || ReadVarint(format_id) == false
+          || (has_location == true && ReadVarint(location_id) == false)
+          || ReadVarint(payload_size) == false || ReadVarint(fields_size) == false
+          || payload_size > MAX_RECORD_SIZE || fields_size > MAX_RECORD_SIZE)
+      {
+        corrupted = true;
+        return false;
+      }
+
+      const SourceLocation * location = nullptr;
+      if (has_location == true)
+      {
+        auto it = locations.find(location_id);
+        if (it == locations.end())
+        {
+          corrupted = true;
+          return false;
+        }
+        location = it->second;
+      }
+
+      payload.resize(payload_size + fields_size);
+      if (Read(&payload[0], payload.size()) == false)
+      {
+        corrupted = true;
+        return false;
+      }
+
+      last_time_ns += UnZigZag(time_delta);
+      last_sequence += static_cast<std::uint64_t>(UnZigZag(sequence_delta));
+
+      o_event.level = static_cast<LoggerEvent::Level>(level);
+      o_event.time_ns = last_time_ns;
+      o_event.time = static_cast<std::time_t>(last_time_ns / 1000000000);
+      o_event.sequence = last_sequence;
+      o_event.location = location;
+      o_event.format = nullptr;
+      o_event.args.clear();
+      o_event.data.clear();
+
+      if (format_id == binary_log::NO_FORMAT)
+      {
+        o_event.data.assign(payload.data(), payload_size);
+      }
+      else
+      {
+        auto it = formats.find(format_id);
+        if (it == formats.end())
+        {
+          corrupted = true;
+          return false;
+        }
+        RenderFormat(it->second.c_str(), payload.data(), payload_size, o_event.data);
+      }
+
+      o_event.fields.assign(payload.data() + payload_size, fields_size);
+      return true;
+    }
+  }
+}
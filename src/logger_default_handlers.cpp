@@ -1,7 +1,105 @@
 #include "logger_default_handlers.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef LOGGER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 namespace slx
 {
+  namespace
+  {
+    void RenderDefaultLine(std::string & o_buffer, const LoggerEvent & i_event, bool i_left_align)
+    {
+      std::string_view level = GetLevelName(i_event.level);
+      std::size_t padding = level.size() < 5 ? 5 - level.size() : 0;
+
+      char timestamp[32];
+      std::int64_t time_ns = i_event.time_ns != 0 ? i_event.time_ns : static_cast<std::int64_t>(i_event.time) * 1000000000;
+      std::size_t timestamp_len = Logger::FormatTimestampNs(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", time_ns);
+
+      o_buffer.append(timestamp, timestamp_len);
+      o_buffer += ' ';
+      if (i_left_align == false)
+      {
+        o_buffer.append(padding, ' ');
+      }
+      o_buffer += level;
+      if (i_left_align == true)
+      {
+        o_buffer.append(padding, ' ');
+      }
+      o_buffer += " : ";
+      o_buffer.append(i_event.data.data(), i_event.data.size());
+      if (i_event.fields.empty() == false)
+      {
+        RenderFieldsText(o_buffer, i_event.fields.data(), i_event.fields.size());
+      }
+      o_buffer += '\n';
+    }
+
+    void RenderJsonLine(std::string & o_buffer, const LoggerEvent & i_event)
+    {
+      char timestamp[48];
+      std::int64_t time_ns = i_event.time_ns != 0 ? i_event.time_ns : static_cast<std::int64_t>(i_event.time) * 1000000000;
+      std::size_t timestamp_len = Logger::FormatTimestampNs(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S.%9N", time_ns);
+
+      char sequence[24];
+      int sequence_len = snprintf(sequence, sizeof(sequence), "%llu", static_cast<unsigned long long>(i_event.sequence));
+
+      std::string_view level = GetLevelName(i_event.level);
+
+      o_buffer += "{\"time\":\"";
+      o_buffer.append(timestamp, timestamp_len);
+      o_buffer += "\",\"seq\":";
+      o_buffer.append(sequence, static_cast<std::size_t>(sequence_len));
+      o_buffer += ",\"level\":\"";
+      o_buffer += level;
+      o_buffer += "\",\"message\":";
+      AppendJsonString(o_buffer, i_event.data.data(), i_event.data.size());
+      if (i_event.location != nullptr)
+      {
+        char line[16];
+        int line_len = snprintf(line, sizeof(line), "%u", static_cast<unsigned>(i_event.location->line));
+
+        o_buffer += ",\"file\":";
+        AppendJsonString(o_buffer, i_event.location->file, std::strlen(i_event.location->file));
+        o_buffer += ",\"line\":";
+        o_buffer.append(line, static_cast<std::size_t>(line_len));
+        o_buffer += ",\"function\":";
+        AppendJsonString(o_buffer, i_event.location->function, std::strlen(i_event.location->function));
+      }
+      RenderFieldsJson(o_buffer, i_event.fields.data(), i_event.fields.size());
+      o_buffer += "}\n";
+    }
+  }
+
+  void AppendDefaultLine(std::string & o_buffer, const LoggerEvent & i_event, bool i_left_align)
+  {
+    AppendCachedLine(o_buffer, i_event, i_left_align == true ? LINE_LAYOUT_DEFAULT_LEFT_ALIGN : LINE_LAYOUT_DEFAULT,
+                     [&](std::string & o_line)
+                     {
+                       RenderDefaultLine(o_line, i_event, i_left_align);
+                     });
+  }
+
+  void AppendJsonLine(std::string & o_buffer, const LoggerEvent & i_event)
+  {
+    AppendCachedLine(o_buffer, i_event, LINE_LAYOUT_JSON,
+                     [&](std::string & o_line)
+                     {
+                       RenderJsonLine(o_line, i_event);
+                     });
+  }
+
   HandlerFilename::HandlerFilename(const std::string &i_filename)
     : HandlerInterface(), file(i_filename, std::ios_base::app)
   {
@@ -9,51 +107,568 @@ namespace slx
   }
 
   int HandlerFilename::HandlerFunction(const LoggerEvent &i_event)
+  {
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerFilename::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
   {
     if (file.is_open() == false)
     {
       return 1;
     }
 
-    file << Logger::FormatTimestamp("%Y-%m-%d %H:%M:%S", i_event.time)
-         << " " << std::setw(5) << g_log_level_strings.at(i_event.level)
-         << " : ";
-    file << i_event.data << std::endl;
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      AppendLine(buffer, *i_events[i]);
+    }
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    if (FlushRequired(i_events, i_count) == true)
+    {
+      file.flush();
+    }
 
     return 0;
   }
 
+  void HandlerFilename::FlushFunction()
+  {
+    file.flush();
+  }
+
   HandlerStream::HandlerStream(std::ostream & i_stream)
     : out(i_stream)
   {
 
   }
 
+  HandlerStream::~HandlerStream()
+  {
+    out.flush();
+  }
+
   int HandlerStream::HandlerFunction(const LoggerEvent &i_event)
   {
-    out << Logger::FormatTimestamp("%Y-%m-%d %H:%M:%S", i_event.time)
-        << " " << std::setw(5) << g_log_level_strings.at(i_event.level)
-        << " : ";
-    out << i_event.data << std::endl;
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerStream::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      AppendLine(buffer, *i_events[i]);
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    if (FlushRequired(i_events, i_count) == true)
+    {
+      out.flush();
+    }
 
     return 0;
   }
 
+  void HandlerStream::FlushFunction()
+  {
+    out.flush();
+  }
+
   HandlerFILE::HandlerFILE(FILE *i_file)
     : file(i_file)
   {
 
   }
 
+  HandlerFILE::~HandlerFILE()
+  {
+    if (file != nullptr)
+    {
+      fflush(file);
+    }
+  }
+
   int HandlerFILE::HandlerFunction(const LoggerEvent &i_event)
+  {
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerFILE::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
   {
     if (file == nullptr)
     {
       return 1;
     }
 
-    fprintf(file, "%s %-5s : %s\n", Logger::FormatTimestamp("%Y-%m-%d %H:%M:%S", i_event.time).c_str(),
-            g_log_level_strings.at(i_event.level).c_str(), i_event.data.c_str());
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      AppendLine(buffer, *i_events[i], true);
+    }
+    fwrite(buffer.data(), 1, buffer.size(), file);
+
+    if (FlushRequired(i_events, i_count) == true)
+    {
+      fflush(file);
+    }
+
+    return 0;
+  }
+
+  void HandlerFILE::FlushFunction()
+  {
+    if (file != nullptr)
+    {
+      fflush(file);
+    }
+  }
+
+  HandlerJsonFile::HandlerJsonFile(const std::string &i_filename)
+    : HandlerInterface(), file(i_filename, std::ios_base::app)
+  {
+
+  }
+
+  int HandlerJsonFile::HandlerFunction(const LoggerEvent &i_event)
+  {
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerJsonFile::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    if (file.is_open() == false)
+    {
+      return 1;
+    }
+
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      AppendJsonLine(buffer, *i_events[i]);
+    }
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    if (FlushRequired(i_events, i_count) == true)
+    {
+      file.flush();
+    }
+
+    return 0;
+  }
+
+  void HandlerJsonFile::FlushFunction()
+  {
+    file.flush();
+  }
+
+  HandlerMmapFile::HandlerMmapFile(const std::string & i_filename, std::size_t i_segment_size)
+    : fd(-1), segment_size(0), mapping(nullptr), segment_offset(0), tail(0), synced(0)
+  {
+    std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    segment_size = (std::max(i_segment_size, page_size) + page_size - 1) / page_size * page_size;
+
+    FlushPolicy policy;
+    policy.every_n = 0;
+    policy.interval = std::chrono::milliseconds(1000);
+    policy.level = LoggerEvent::Level::ERROR;
+    SetFlushPolicy(policy);
+
+    fd = open(i_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+      return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+      close(fd);
+      fd = -1;
+      return;
+    }
+
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    std::size_t offset = size / page_size * page_size;
+    if (MapSegment(offset) == false)
+    {
+      close(fd);
+      fd = -1;
+      return;
+    }
+
+    tail = size - offset;
+    synced = tail;
+  }
+
+  HandlerMmapFile::~HandlerMmapFile()
+  {
+    Close();
+  }
+
+  int HandlerMmapFile::Close()
+  {
+    std::unique_lock<std::mutex> events_lock(events_mtx);
+
+    if (mapping != nullptr)
+    {
+      msync(mapping, tail, MS_SYNC);
+      munmap(mapping, segment_size);
+      mapping = nullptr;
+    }
+
+    int res = 0;
+    if (fd >= 0)
+    {
+      // Неиспользованная часть последнего сегмента отрезается
+      if (ftruncate(fd, static_cast<off_t>(segment_offset + tail)) != 0)
+      {
+        res = 1;
+      }
+      close(fd);
+      fd = -1;
+    }
+    return res;
+  }
+
+  bool HandlerMmapFile::IsOpen() const
+  {
+    return mapping != nullptr;
+  }
+
+  int HandlerMmapFile::HandlerFunction(const LoggerEvent &i_event)
+  {
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerMmapFile::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    if (mapping == nullptr)
+    {
+      return 1;
+    }
+
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      AppendLine(buffer, *i_events[i]);
+    }
+
+    if (Write(buffer.data(), buffer.size()) == false)
+    {
+      return 1;
+    }
+
+    if (FlushRequired(i_events, i_count) == true)
+    {
+      FlushFunction();
+    }
+
     return 0;
   }
-}
\ No newline at end of file
+
+  void HandlerMmapFile::FlushFunction()
+  {
+    if (mapping == nullptr || synced == tail)
+    {
+      return;
+    }
+
+    // msync требует адрес, выровненный по странице
+    std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t begin = synced / page_size * page_size;
+    msync(mapping + begin, tail - begin, MS_SYNC);
+    synced = tail;
+  }
+
+  bool HandlerMmapFile::MapSegment(std::size_t i_offset)
+  {
+    if (mapping != nullptr)
+    {
+      msync(mapping, segment_size, MS_ASYNC);
+      munmap(mapping, segment_size);
+      mapping = nullptr;
+    }
+
+    if (posix_fallocate(fd, static_cast<off_t>(i_offset), static_cast<off_t>(segment_size)) != 0)
+    {
+      return false;
+    }
+
+    void * address = mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, static_cast<off_t>(i_offset));
+    if (address == MAP_FAILED)
+    {
+      return false;
+    }
+
+    mapping = static_cast<char *>(address);
+    segment_offset = i_offset;
+    tail = 0;
+    synced = 0;
+    return true;
+  }
+
+  bool HandlerMmapFile::Write(const char *i_data, std::size_t i_size)
+  {
+    while (i_size > 0)
+    {
+      if (tail == segment_size)
+      {
+        if (MapSegment(segment_offset + segment_size) == false)
+        {
+          return false;
+        }
+      }
+
+      std::size_t chunk = std::min(i_size, segment_size - tail);
+      std::memcpy(mapping + tail, i_data, chunk);
+      tail += chunk;
+      i_data += chunk;
+      i_size -= chunk;
+    }
+
+    return true;
+  }
+
+  HandlerRotatingFile::HandlerRotatingFile(const std::string & i_filename, const RotationPolicy & i_policy)
+    : filename(i_filename), policy(i_policy), file_size(0), rotation_counter(0), archive_active(true)
+  {
+    OpenFile();
+    archive_thread = std::thread(ArchiveWorker, this);
+  }
+
+  HandlerRotatingFile::~HandlerRotatingFile()
+  {
+    file.close();
+
+    pending_mtx.lock();
+    archive_active = false;
+    pending_mtx.unlock();
+    pending_cv.notify_one();
+
+    archive_thread.join();
+  }
+
+  bool HandlerRotatingFile::IsCompressionAvailable()
+  {
+#ifdef LOGGER_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  int HandlerRotatingFile::HandlerFunction(const LoggerEvent &i_event)
+  {
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerRotatingFile::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      std::size_t line_begin = buffer.size();
+      AppendLine(buffer, *i_events[i]);
+
+      if (RotationRequired(buffer.size(), buffer.size() - line_begin) == true)
+      {
+        // Строка, переполнившая файл, переносится в новый файл
+        std::string line = buffer.substr(line_begin);
+        buffer.resize(line_begin);
+        WriteBuffer();
+        Rotate();
+        buffer = line;
+      }
+    }
+    WriteBuffer();
+
+    if (file.is_open() == false)
+    {
+      return 1;
+    }
+
+    if (FlushRequired(i_events, i_count) == true)
+    {
+      file.flush();
+    }
+
+    return 0;
+  }
+
+  void HandlerRotatingFile::FlushFunction()
+  {
+    file.flush();
+  }
+
+  void HandlerRotatingFile::OpenFile()
+  {
+    file.open(filename, std::ios_base::out | std::ios_base::app);
+
+    struct stat st;
+    file_size = stat(filename.c_str(), &st) == 0 ? static_cast<std::size_t>(st.st_size) : 0;
+
+    if (policy.interval.count() > 0)
+    {
+      auto now = std::chrono::system_clock::now().time_since_epoch();
+      auto periods = std::chrono::duration_cast<std::chrono::seconds>(now) / policy.interval;
+      next_rotation = std::chrono::system_clock::time_point(policy.interval * (periods + 1));
+    }
+  }
+
+  void HandlerRotatingFile::Rotate()
+  {
+    file.close();
+
+    std::string pending_name = filename + ".pending." + std::to_string(getpid()) + "." + std::to_string(rotation_counter++);
+    bool renamed = (std::rename(filename.c_str(), pending_name.c_str()) == 0);
+
+    OpenFile();
+
+    if (renamed == false)
+    {
+      // Иначе ротация повторялась бы перед каждой записью в тот же переполненный файл
+      rotation_retry = std::chrono::steady_clock::now() + ROTATION_RETRY_INTERVAL;
+    }
+    else
+    {
+      rotation_retry = std::chrono::steady_clock::time_point();
+
+      pending_mtx.lock();
+      pending.push_back(pending_name);
+      pending_mtx.unlock();
+      pending_cv.notify_one();
+    }
+  }
+
+  bool HandlerRotatingFile::RotationRequired(std::size_t i_size, std::size_t i_line_size) const
+  {
+    // file_size обновляется только при записи буфера, поэтому учитываются и строки, ожидающие записи
+    bool single_line = (file_size == 0 && i_size == i_line_size);
+    bool required = (policy.max_size != 0 && single_line == false && file_size + i_size > policy.max_size)
+                    || (policy.interval.count() > 0 && std::chrono::system_clock::now() >= next_rotation);
+
+    if (required == true && rotation_retry.time_since_epoch().count() != 0)
+    {
+      return std::chrono::steady_clock::now() >= rotation_retry;
+    }
+
+    return required;
+  }
+
+  void HandlerRotatingFile::WriteBuffer()
+  {
+    if (buffer.empty() == true || file.is_open() == false)
+    {
+      return;
+    }
+
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    file_size += buffer.size();
+    buffer.clear();
+  }
+
+  void HandlerRotatingFile::ArchiveWorker(HandlerRotatingFile *d_handler)
+  {
+    std::unique_lock<std::mutex> lock(d_handler->pending_mtx);
+    for (;;)
+    {
+      d_handler->pending_cv.wait(lock, [d_handler]
+      {
+        return d_handler->pending.empty() == false || d_handler->archive_active == false;
+      });
+
+      if (d_handler->pending.empty() == true)
+      {
+        return;
+      }
+
+      std::string name = d_handler->pending.front();
+      d_handler->pending.pop_front();
+
+      lock.unlock();
+      d_handler->Archive(name);
+      lock.lock();
+    }
+  }
+
+  void HandlerRotatingFile::Archive(const std::string &i_pending)
+  {
+    if (policy.generations == 0)
+    {
+      std::remove(i_pending.c_str());
+      return;
+    }
+
+    // Поколение может храниться как сжатым, так и без сжатия, если сжать его не удалось
+    std::remove(GenerationName(policy.generations, true).c_str());
+    std::remove(GenerationName(policy.generations, false).c_str());
+    for (std::size_t generation = policy.generations; generation > 1; --generation)
+    {
+      std::rename(GenerationName(generation - 1, true).c_str(), GenerationName(generation, true).c_str());
+      std::rename(GenerationName(generation - 1, false).c_str(), GenerationName(generation, false).c_str());
+    }
+
+    bool compress = (policy.compression == Compression::GZIP && IsCompressionAvailable() == true);
+    std::string target = GenerationName(1, compress);
+
+#ifdef LOGGER_HAVE_ZLIB
+    if (compress == true)
+    {
+      FILE * input = fopen(i_pending.c_str(), "rb");
+      gzFile output = gzopen(target.c_str(), "wb");
+      bool success = (input != nullptr && output != nullptr);
+
+      char chunk[64 * 1024];
+      while (success == true)
+      {
+        std::size_t read = fread(chunk, 1, sizeof(chunk), input);
+        if (read == 0)
+        {
+          success = (ferror(input) == 0);
+          break;
+        }
+        success = (gzwrite(output, chunk, static_cast<unsigned>(read)) == static_cast<int>(read));
+      }
+
+      if (input != nullptr)
+      {
+        fclose(input);
+      }
+      if (output != nullptr && gzclose(output) != Z_OK)
+      {
+        success = false;
+      }
+
+      if (success == true)
+      {
+        std::remove(i_pending.c_str());
+        return;
+      }
+
+      // Если сжать не удалось, файл сохраняется без сжатия
+      std::remove(target.c_str());
+      target = GenerationName(1, false);
+    }
+#endif
+
+    std::rename(i_pending.c_str(), target.c_str());
+  }
+
+  std::string HandlerRotatingFile::GenerationName(std::size_t i_generation, bool i_compressed) const
+  {
+    std::string name = filename + "." + std::to_string(i_generation);
+    if (i_compressed == true)
+    {
+      name += ".gz";
+    }
+    return name;
+  }
+}
@@ -0,0 +1,535 @@
+#include "logger_format.hpp"
+#include "logger.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+namespace slx
+{
+  namespace format_detail
+  {
+    void FormatStringError(const char *)
+    {
+
+    }
+  }
+
+  namespace
+  {
+    //! Прочитать значение из двоичного представления аргументов
+    template<typename V>
+    bool ReadValue(const char *&io_pos, const char *i_end, V &o_value)
+    {
+      if (static_cast<std::size_t>(i_end - io_pos) < sizeof(V))
+      {
+        return false;
+      }
+
+      std::memcpy(&o_value, io_pos, sizeof(V));
+      io_pos += sizeof(V);
+      return true;
+    }
+
+    //! Прочитать целое значение любой разрядности
+    /*!
+      Знаковые значения расширяются знаком до 64 бит, беззнаковые - нулями.
+      \param o_bits Разрядность исходного значения
+      \return false Тип не целый или данные закончились
+    */
+    bool ReadInteger(const char *&io_pos, const char *i_end, FormatArgType i_type, std::uint64_t &o_value, unsigned &o_bits)
+    {
+      switch (i_type)
+      {
+        case FormatArgType::INT:
+        case FormatArgType::UINT:
+          o_bits = 64;
+          return ReadValue(io_pos, i_end, o_value);
+        case FormatArgType::INT32:
+        {
+          std::int32_t value = 0;
+          o_bits = 32;
+          if (ReadValue(io_pos, i_end, value) == false)
+          {
+            return false;
+          }
+          o_value = static_cast<std::uint64_t>(static_cast<std::int64_t>(value));
+          return true;
+        }
+        case FormatArgType::UINT32:
+        {
+          std::uint32_t value = 0;
+          o_bits = 32;
+          if (ReadValue(io_pos, i_end, value) == false)
+          {
+            return false;
+          }
+          o_value = value;
+          return true;
+        }
+        default:
+          return false;
+      }
+    }
+
+    //! Добавить результат snprintf в конец строки
+    template<typename... V>
+    void AppendPrintf(EventData &o_data, const char *i_spec, V... i_values)
+    {
+      char buffer[128];
+      int res = snprintf(buffer, sizeof(buffer), i_spec, i_values...);
+      if (res < 0)
+      {
+        return;
+      }
+
+      if (static_cast<std::size_t>(res) < sizeof(buffer))
+      {
+        o_data.append(buffer, static_cast<std::size_t>(res));
+        return;
+      }
+
+      std::string large(static_cast<std::size_t>(res) + 1, '\0');
+      snprintf(&large[0], large.size(), i_spec, i_values...);
+      o_data.append(large.data(), static_cast<std::size_t>(res));
+    }
+  }
+
+  void RenderFormat(const char *i_fmt, const char *i_args, std::size_t i_args_size, EventData &o_data)
+  {
+    const char * pos = i_args;
+    const char * end = i_args + i_args_size;
+    const char * literal = i_fmt;
+    const char * p = i_fmt;
+
+    while (*p != '\0')
+    {
+      if (*p != '%')
+      {
+        ++p;
+        continue;
+      }
+
+      o_data.append(literal, static_cast<std::size_t>(p - literal));
+
+      if (p[1] == '%')
+      {
+        o_data.append("%", 1);
+        p += 2;
+        literal = p;
+        continue;
+      }
+
+      // Спецификатор собирается заново: флаги, ширина и точность сохраняются,
+      // модификатор длины заменяется на соответствующий типу сохраненного аргумента
+      char spec[32];
+      std::size_t spec_len = 0;
+      spec[spec_len++] = *p++;
+
+      while (format_detail::IsFlag(*p) || format_detail::IsDigit(*p) || *p == '.')
+      {
+        if (spec_len < sizeof(spec) - 4)
+        {
+          spec[spec_len++] = *p;
+        }
+        ++p;
+      }
+      // Модификаторы h и hh сокращают разрядность целого, как в printf
+      unsigned modifier_bits = 64;
+      while (format_detail::IsLengthModifier(*p))
+      {
+        if (*p == 'h')
+        {
+          modifier_bits = modifier_bits == 16 ? 8 : 16;
+        }
+        ++p;
+      }
+
+      if (*p == '\0')
+      {
+        literal = p;
+        break;
+      }
+
+      char conv = *p++;
+      literal = p;
+
+      if (pos >= end)
+      {
+        continue;
+      }
+
+      FormatArgType type = static_cast<FormatArgType>(*pos++);
+      switch (type)
+      {
+        case FormatArgType::INT:
+        case FormatArgType::UINT:
+        case FormatArgType::INT32:
+        case FormatArgType::UINT32:
+        {
+          std::uint64_t value = 0;
+          unsigned bits = 64;
+          if (ReadInteger(pos, end, type, value, bits) == false)
+          {
+            return;
+          }
+          bits = std::min(bits, modifier_bits);
+
+          if (conv == 'c')
+          {
+            spec[spec_len++] = 'c';
+            spec[spec_len] = '\0';
+            AppendPrintf(o_data, spec, static_cast<int>(value));
+          }
+          else
+          {
+            spec[spec_len++] = 'l';
+            spec[spec_len++] = 'l';
+            spec[spec_len++] = conv;
+            spec[spec_len] = '\0';
+            bool is_signed = type == FormatArgType::INT || type == FormatArgType::INT32;
+            if (is_signed == true && (conv == 'd' || conv == 'i'))
+            {
+              // Расширение знаком от разрядности аргумента
+              long long signed_value = static_cast<long long>(value << (64 - bits)) >> (64 - bits);
+              AppendPrintf(o_data, spec, signed_value);
+            }
+            else
+            {
+              if (bits < 64)
+              {
+                value &= (std::uint64_t(1) << bits) - 1;
+              }
+              AppendPrintf(o_data, spec, static_cast<unsigned long long>(value));
+            }
+          }
+          break;
+        }
+        case FormatArgType::DOUBLE:
+        {
+          double value = 0;
+          if (ReadValue(pos, end, value) == false)
+          {
+            return;
+          }
+
+          spec[spec_len++] = conv;
+          spec[spec_len] = '\0';
+          AppendPrintf(o_data, spec, value);
+          break;
+        }
+        case FormatArgType::POINTER:
+        {
+          std::uintptr_t value = 0;
+          if (ReadValue(pos, end, value) == false)
+          {
+            return;
+          }
+
+          spec[spec_len++] = 'p';
+          spec[spec_len] = '\0';
+          AppendPrintf(o_data, spec, reinterpret_cast<void *>(value));
+          break;
+        }
+        case FormatArgType::STRING:
+        {
+          std::uint32_t size = 0;
+          if (ReadValue(pos, end, size) == false || static_cast<std::size_t>(end - pos) < size)
+          {
+            return;
+          }
+
+          if (spec_len == 1)
+          {
+            o_data.append(pos, size);
+          }
+          else
+          {
+            // Строка хранится без завершающего нуля, ее длина ограничивается точностью
+            std::string value(pos, size);
+            spec[spec_len++] = 's';
+            spec[spec_len] = '\0';
+            AppendPrintf(o_data, spec, value.c_str());
+          }
+          pos += size;
+          break;
+        }
+        default:
+          return;
+      }
+    }
+
+    o_data.append(literal, static_cast<std::size_t>(p - literal));
+  }
+
+  bool ReadField(const char *&io_pos, const char *i_end, FieldValue &o_field)
+  {
+    const char * pos = io_pos;
+    if (pos >= i_end)
+    {
+      return false;
+    }
+
+    std::size_t key_size = static_cast<unsigned char>(*pos++);
+    if (static_cast<std::size_t>(i_end - pos) < key_size + 1)
+    {
+      return false;
+    }
+    o_field.key = std::string_view(pos, key_size);
+    pos += key_size;
+
+    o_field.type = static_cast<FormatArgType>(*pos++);
+    switch (o_field.type)
+    {
+      case FormatArgType::INT32:
+      case FormatArgType::UINT32:
+      {
+        unsigned bits = 0;
+        if (ReadInteger(pos, i_end, o_field.type, o_field.integer, bits) == false)
+        {
+          return false;
+        }
+        o_field.type = o_field.type == FormatArgType::INT32 ? FormatArgType::INT : FormatArgType::UINT;
+        break;
+      }
+      case FormatArgType::INT:
+      case FormatArgType::UINT:
+      case FormatArgType::POINTER:
+      {
+        if (ReadValue(pos, i_end, o_field.integer) == false)
+        {
+          return false;
+        }
+        break;
+      }
+      case FormatArgType::DOUBLE:
+      {
+        if (ReadValue(pos, i_end, o_field.floating) == false)
+        {
+          return false;
+        }
+        break;
+      }
+      case FormatArgType::BOOL:
+      {
+        std::uint8_t value = 0;
+        if (ReadValue(pos, i_end, value) == false)
+        {
+          return false;
+        }
+        o_field.integer = value;
+        break;
+      }
+      case FormatArgType::STRING:
+      {
+        std::uint32_t size = 0;
+        if (ReadValue(pos, i_end, size) == false || static_cast<std::size_t>(i_end - pos) < size)
+        {
+          return false;
+        }
+        o_field.string = std::string_view(pos, size);
+        pos += size;
+        break;
+      }
+      default:
+        return false;
+    }
+
+    io_pos = pos;
+    return true;
+  }
+
+  namespace
+  {
+    //! Проверить, совпадает ли имя поля с членом строки JSON, который выводит сам обработчик
+    bool IsReservedJsonKey(std::string_view i_key)
+    {
+      static const std::string_view RESERVED_KEYS[] = {"time", "seq", "level", "message", "file", "line", "function"};
+      return std::find(std::begin(RESERVED_KEYS), std::end(RESERVED_KEYS), i_key) != std::end(RESERVED_KEYS);
+    }
+
+    //! Добавить числовое значение поля в текстовом виде
+    /*!
+      \return false Значение не числовое
+    */
+    bool AppendNumber(std::string &o_buffer, const FieldValue &i_field)
+    {
+      char buffer[64];
+      int res;
+      switch (i_field.type)
+      {
+        case FormatArgType::INT:
+          res = snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(i_field.integer));
+          break;
+        case FormatArgType::UINT:
+          res = snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(i_field.integer));
+          break;
+        case FormatArgType::DOUBLE:
+          res = snprintf(buffer, sizeof(buffer), "%.17g", i_field.floating);
+          break;
+        case FormatArgType::POINTER:
+          res = snprintf(buffer, sizeof(buffer), "0x%llx", static_cast<unsigned long long>(i_field.integer));
+          break;
+        default:
+          return false;
+      }
+
+      if (res > 0)
+      {
+        o_buffer.append(buffer, std::min(static_cast<std::size_t>(res), sizeof(buffer) - 1));
+      }
+      return true;
+    }
+  }
+
+  void RenderFieldsText(std::string &o_buffer, const char *i_fields, std::size_t i_size)
+  {
+    const char * pos = i_fields;
+    const char * end = i_fields + i_size;
+    FieldValue field;
+
+    while (ReadField(pos, end, field) == true)
+    {
+      o_buffer += ' ';
+      o_buffer.append(field.key.data(), field.key.size());
+      o_buffer += '=';
+
+      if (field.type == FormatArgType::BOOL)
+      {
+        o_buffer += field.integer != 0 ? "true" : "false";
+      }
+      else if (field.type == FormatArgType::STRING)
+      {
+        bool quote = field.string.empty() == true
+                     || field.string.find_first_of(" =\"\t\n\r") != std::string_view::npos;
+        if (quote == false)
+        {
+          o_buffer.append(field.string.data(), field.string.size());
+          continue;
+        }
+
+        // Значение не должно разрывать строку события
+        o_buffer += '"';
+        for (char ch : field.string)
+        {
+          switch (ch)
+          {
+            case '"':
+            case '\\':
+              o_buffer += '\\';
+              o_buffer += ch;
+              break;
+            case '\n':
+              o_buffer += "\\n";
+              break;
+            case '\r':
+              o_buffer += "\\r";
+              break;
+            case '\t':
+              o_buffer += "\\t";
+              break;
+            default:
+              o_buffer += ch;
+              break;
+          }
+        }
+        o_buffer += '"';
+      }
+      else
+      {
+        AppendNumber(o_buffer, field);
+      }
+    }
+  }
+
+  void RenderFieldsJson(std::string &o_buffer, const char *i_fields, std::size_t i_size)
+  {
+    const char * pos = i_fields;
+    const char * end = i_fields + i_size;
+    FieldValue field;
+
+    while (ReadField(pos, end, field) == true)
+    {
+      o_buffer += ',';
+      if (IsReservedJsonKey(field.key) == true)
+      {
+        std::string key = "field_";
+        key.append(field.key.data(), field.key.size());
+        AppendJsonString(o_buffer, key.data(), key.size());
+      }
+      else
+      {
+        AppendJsonString(o_buffer, field.key.data(), field.key.size());
+      }
+      o_buffer += ':';
+
+      if (field.type == FormatArgType::BOOL)
+      {
+        o_buffer += field.integer != 0 ? "true" : "false";
+      }
+      else if (field.type == FormatArgType::STRING)
+      {
+        AppendJsonString(o_buffer, field.string.data(), field.string.size());
+      }
+      else if (field.type == FormatArgType::POINTER)
+      {
+        o_buffer += '"';
+        AppendNumber(o_buffer, field);
+        o_buffer += '"';
+      }
+      else if (field.type == FormatArgType::DOUBLE && std::isfinite(field.floating) == false)
+      {
+        o_buffer += "null";
+      }
+      else
+      {
+        AppendNumber(o_buffer, field);
+      }
+    }
+  }
+
+  void AppendJsonString(std::string &o_buffer, const char *i_data, std::size_t i_size)
+  {
+    static const char hex[] = "0123456789abcdef";
+
+    o_buffer += '"';
+    const char * literal = i_data;
+    const char * end = i_data + i_size;
+    for (const char * p = i_data; p < end; ++p)
+    {
+      unsigned char ch = static_cast<unsigned char>(*p);
+      if (ch >= 0x20 && ch != '"' && ch != '\\')
+      {
+        continue;
+      }
+
+      o_buffer.append(literal, static_cast<std::size_t>(p - literal));
+      literal = p + 1;
+
+      switch (ch)
+      {
+        case '"':
+          o_buffer += "\\\"";
+          break;
+        case '\\':
+          o_buffer += "\\\\";
+          break;
+        case '\n':
+          o_buffer += "\\n";
+          break;
+        case '\r':
+          o_buffer += "\\r";
+          break;
+        case '\t':
+          o_buffer += "\\t";
+          break;
+        default:
+          o_buffer += "\\u00";
+          o_buffer += hex[ch >> 4];
+          o_buffer += hex[ch & 0x0f];
+          break;
+      }
+    }
+    o_buffer.append(literal, static_cast<std::size_t>(end - literal));
+    o_buffer += '"';
+  }
+}
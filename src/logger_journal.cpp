@@ -0,0 +1,260 @@
+#include "logger_journal.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace slx
+{
+  namespace
+  {
+    const char JOURNAL_MAGIC[8] = {'S', 'L', 'X', 'J', 'R', 'N', 'L', '1'};
+
+    //! Бит пометки ожидания в stamp
+    const std::uint64_t STAMP_PENDING = 1;
+  }
+
+  //! Заголовок файла журнала
+  struct EventJournal::Header
+  {
+    char magic[8];
+    std::uint64_t slot_size;
+    std::uint64_t slot_count;
+    char reserved[SLOT_SIZE - 24];
+  };
+
+  //! Ячейка кольца
+  struct EventJournal::Slot
+  {
+    //! 0 - пустая ячейка, ((sequence + 1) << 1) | STAMP_PENDING - ожидающее событие
+    std::atomic<std::uint64_t> stamp;
+    std::int64_t time_ns;
+    std::uint8_t level;
+    std::uint8_t reserved;
+    //! Длина строки формата. 0 - событие без отложенного форматирования
+    std::uint16_t format_size;
+    //! Размер аргументов, если есть строка формата, иначе длина текста
+    std::uint16_t data_size;
+    std::uint16_t fields_size;
+    //! Строка формата, данные и поля подряд
+    char payload[SLOT_SIZE - 24];
+  };
+
+  EventJournal::EventJournal()
+    : fd(-1), map(nullptr), map_size(0), header(nullptr), slots(nullptr), mask(0)
+  {
+    static_assert(sizeof(Header) == SLOT_SIZE, "journal header size");
+    static_assert(sizeof(Slot) == SLOT_SIZE, "journal slot size");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "journal stamp must be lock-free");
+  }
+
+  EventJournal::~EventJournal()
+  {
+    Unmap();
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+  }
+
+  bool EventJournal::Open(const std::string &i_filename, std::size_t i_capacity, std::vector<LoggerEvent> &o_recovered)
+  {
+    fd = open(i_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+      return false;
+    }
+
+    std::size_t capacity = 2;
+    while (capacity < i_capacity)
+    {
+      capacity <<= 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+      return false;
+    }
+
+    if (st.st_size != 0)
+    {
+      // Непустой файл без сигнатуры журнала не перезаписывается: скорее всего, указан не тот файл
+      char magic[sizeof(JOURNAL_MAGIC)];
+      if (pread(fd, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic))
+          || std::memcmp(magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0)
+      {
+        return false;
+      }
+    }
+
+    if (static_cast<std::size_t>(st.st_size) >= sizeof(Header) && Map(static_cast<std::size_t>(st.st_size)) == true)
+    {
+      Recover(o_recovered);
+      if (mask + 1 == capacity)
+      {
+        // Геометрия совпадает, журнал очищается на месте
+        for (std::size_t i = 0; i <= mask; ++i)
+        {
+          slots[i].stamp.store(0, std::memory_order_relaxed);
+        }
+        return true;
+      }
+      Unmap();
+    }
+
+    return Init(capacity);
+  }
+
+  bool EventJournal::Map(std::size_t i_size)
+  {
+    void * addr = mmap(nullptr, i_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      return false;
+    }
+
+    Header * candidate = static_cast<Header *>(addr);
+    std::uint64_t count = candidate->slot_count;
+    if (std::memcmp(candidate->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0
+        || candidate->slot_size != SLOT_SIZE || count < 2 || (count & (count - 1)) != 0
+        || i_size < sizeof(Header) + count * sizeof(Slot))
+    {
+      munmap(addr, i_size);
+      return false;
+    }
+
+    map = addr;
+    map_size = i_size;
+    header = candidate;
+    slots = reinterpret_cast<Slot *>(static_cast<char *>(addr) + sizeof(Header));
+    mask = count - 1;
+    return true;
+  }
+
+  void EventJournal::Unmap()
+  {
+    if (map != nullptr)
+    {
+      munmap(map, map_size);
+    }
+    map = nullptr;
+    map_size = 0;
+    header = nullptr;
+    slots = nullptr;
+    mask = 0;
+  }
+
+  bool EventJournal::Init(std::size_t i_capacity)
+  {
+    std::size_t size = sizeof(Header) + i_capacity * sizeof(Slot);
+
+    // Файл обрезается, чтобы старые ячейки не приняли за ожидающие события.
+    // Заголовок записывается до расширения файла, чтобы при сбое не остался непустой файл без сигнатуры
+    if (ftruncate(fd, 0) != 0)
+    {
+      return false;
+    }
+
+    Header initial;
+    std::memset(&initial, 0, sizeof(initial));
+    std::memcpy(initial.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    initial.slot_size = SLOT_SIZE;
+    initial.slot_count = i_capacity;
+    if (pwrite(fd, &initial, sizeof(initial), 0) != static_cast<ssize_t>(sizeof(initial))
+        || ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+      return false;
+    }
+
+    return Map(size);
+  }
+
+  void EventJournal::Recover(std::vector<LoggerEvent> &o_recovered)
+  {
+    std::size_t first = o_recovered.size();
+
+    for (std::size_t i = 0; i <= mask; ++i)
+    {
+      const Slot & slot = slots[i];
+      std::uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+      if ((stamp & STAMP_PENDING) == 0 || slot.level > static_cast<std::uint8_t>(LoggerEvent::Level::FATAL))
+      {
+        continue;
+      }
+
+      std::size_t format_size = std::min<std::size_t>(slot.format_size, sizeof(slot.payload));
+      std::size_t data_size = std::min<std::size_t>(slot.data_size, sizeof(slot.payload) - format_size);
+      std::size_t fields_size = std::min<std::size_t>(slot.fields_size, sizeof(slot.payload) - format_size - data_size);
+      const char * data = slot.payload + format_size;
+
+      LoggerEvent event;
+      event.sequence = (stamp >> 1) - 1;
+      event.time_ns = slot.time_ns;
+      event.time = static_cast<std::time_t>(slot.time_ns / 1000000000);
+      event.level = static_cast<LoggerEvent::Level>(slot.level);
+      if (format_size != 0)
+      {
+        std::string format(slot.payload, format_size);
+        RenderFormat(format.c_str(), data, data_size, event.data);
+      }
+      else
+      {
+        event.data.assign(data, data_size);
+      }
+      event.fields.assign(data + data_size, fields_size);
+
+      o_recovered.push_back(std::move(event));
+    }
+
+    std::sort(o_recovered.begin() + static_cast<std::ptrdiff_t>(first), o_recovered.end(),
+              [](const LoggerEvent & i_lhs, const LoggerEvent & i_rhs)
+              {
+                return i_lhs.sequence < i_rhs.sequence;
+              });
+  }
+
+  void EventJournal::Write(const LoggerEvent &i_event)
+  {
+    Slot & slot = slots[i_event.sequence & mask];
+
+    // Пока ячейка заполняется, она не считается ожидающей
+    slot.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_release);
+
+    std::size_t available = sizeof(slot.payload);
+    std::size_t format_size = 0;
+    const EventData * data = &i_event.data;
+    if (i_event.format != nullptr)
+    {
+      format_size = std::min(std::strlen(i_event.format), available);
+      std::memcpy(slot.payload, i_event.format, format_size);
+      data = &i_event.args;
+    }
+    std::size_t data_size = std::min(data->size(), available - format_size);
+    std::memcpy(slot.payload + format_size, data->data(), data_size);
+    std::size_t fields_size = std::min(i_event.fields.size(), available - format_size - data_size);
+    std::memcpy(slot.payload + format_size + data_size, i_event.fields.data(), fields_size);
+
+    slot.time_ns = i_event.time_ns;
+    slot.level = static_cast<std::uint8_t>(i_event.level);
+    slot.format_size = static_cast<std::uint16_t>(format_size);
+    slot.data_size = static_cast<std::uint16_t>(data_size);
+    slot.fields_size = static_cast<std::uint16_t>(fields_size);
+
+    slot.stamp.store(((i_event.sequence + 1) << 1) | STAMP_PENDING, std::memory_order_release);
+  }
+
+  void EventJournal::MarkDelivered(std::uint64_t i_sequence)
+  {
+    Slot & slot = slots[i_sequence & mask];
+    std::uint64_t expected = ((i_sequence + 1) << 1) | STAMP_PENDING;
+    slot.stamp.compare_exchange_strong(expected, expected & ~STAMP_PENDING, std::memory_order_release,
+                                       std::memory_order_relaxed);
+  }
+}
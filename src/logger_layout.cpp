@@ -0,0 +1,355 @@
+#include "logger_layout.hpp"
+#include "logger_default_handlers.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+namespace slx
+{
+  namespace
+  {
+    //! Формат времени %d без фигурных скобок
+    const char DEFAULT_TIMESTAMP_FORMAT[] = "%Y-%m-%d %H:%M:%S";
+
+    //! Получить номер формата в кеше строк события для шаблона
+    /*!
+      Номера не освобождаются. Если номера закончились, возвращается 0 и кеш не используется
+    */
+    std::uint16_t GetLayoutId(const std::string & i_pattern)
+    {
+      static std::mutex ids_mtx;
+      static std::map<std::string, std::uint16_t> ids;
+      static std::uint32_t next_id = LINE_LAYOUT_USER;
+
+      std::unique_lock<std::mutex> lock(ids_mtx);
+
+      auto it = ids.find(i_pattern);
+      if (it != ids.end())
+      {
+        return it->second;
+      }
+
+      if (next_id > UINT16_MAX)
+      {
+        return 0;
+      }
+
+      std::uint16_t id = static_cast<std::uint16_t>(next_id++);
+      ids.emplace(i_pattern, id);
+      return id;
+    }
+
+    void AppendNumber(std::string & o_buffer, std::uint64_t i_value)
+    {
+      char number[24];
+      std::to_chars_result result = std::to_chars(number, number + sizeof(number), i_value);
+      o_buffer.append(number, static_cast<std::size_t>(result.ptr - number));
+    }
+
+    //! Получить имя файла без каталогов
+    const char * BaseName(const char * i_path)
+    {
+      const char * slash = std::strrchr(i_path, '/');
+      return slash != nullptr ? slash + 1 : i_path;
+    }
+  }
+
+  Layout::Layout(const std::string &i_pattern)
+    : pattern(i_pattern), layout_id(GetLayoutId(i_pattern))
+  {
+    Compile();
+  }
+
+  const std::string & Layout::GetPattern() const
+  {
+    return pattern;
+  }
+
+  void Layout::Append(std::string &o_buffer, const LoggerEvent &i_event) const
+  {
+    if (layout_id == 0)
+    {
+      Render(o_buffer, i_event);
+      return;
+    }
+
+    AppendCachedLine(o_buffer, i_event, layout_id,
+                     [&](std::string & o_line)
+                     {
+                       Render(o_line, i_event);
+                     });
+  }
+
+  void Layout::AddLiteral(const char *i_text, std::size_t i_size)
+  {
+    if (i_size == 0)
+    {
+      return;
+    }
+
+    // Соседние тексты объединяются в одну операцию
+    if (ops.empty() == false && ops.back().type == OpType::LITERAL && ops.back().width == 0)
+    {
+      texts.append(i_text, i_size);
+      ops.back().size += static_cast<std::uint32_t>(i_size);
+      return;
+    }
+
+    Op op = {OpType::LITERAL, false, 0, static_cast<std::uint32_t>(texts.size()), static_cast<std::uint32_t>(i_size)};
+    texts.append(i_text, i_size);
+    ops.push_back(op);
+  }
+
+  void Layout::Compile()
+  {
+    const std::size_t length = pattern.size();
+    const char * text = pattern.data();
+
+    std::size_t i = 0;
+    while (i < length)
+    {
+      std::size_t literal_end = pattern.find('%', i);
+      if (literal_end == std::string::npos)
+      {
+        literal_end = length;
+      }
+      AddLiteral(text + i, literal_end - i);
+      i = literal_end;
+      if (i == length)
+      {
+        break;
+      }
+
+      std::size_t spec = i + 1;
+      Op op = {OpType::LITERAL, false, 0, 0, 0};
+      if (spec < length && text[spec] == '-')
+      {
+        op.left_align = true;
+        ++spec;
+      }
+      std::uint32_t width = 0;
+      while (spec < length && text[spec] >= '0' && text[spec] <= '9')
+      {
+        width = std::min<std::uint32_t>(width * 10 + static_cast<std::uint32_t>(text[spec] - '0'), UINT16_MAX);
+        ++spec;
+      }
+      op.width = static_cast<std::uint16_t>(width);
+
+      if (spec == length)
+      {
+        AddLiteral(text + i, length - i);
+        break;
+      }
+
+      std::size_t next = spec + 1;
+      switch (text[spec])
+      {
+        case '%':
+          AddLiteral("%", 1);
+          i = next;
+          continue;
+        case 'd':
+        {
+          op.type = OpType::TIMESTAMP;
+          op.offset = static_cast<std::uint32_t>(texts.size());
+          std::size_t close = next < length && text[next] == '{' ? pattern.find('}', next) : std::string::npos;
+          if (close != std::string::npos)
+          {
+            texts.append(text + next + 1, close - next - 1);
+            next = close + 1;
+          }
+          else
+          {
+            texts += DEFAULT_TIMESTAMP_FORMAT;
+          }
+          op.size = static_cast<std::uint32_t>(texts.size() - op.offset);
+          texts += '\0';
+          break;
+        }
+        case 'l':
+          op.type = OpType::LEVEL;
+          break;
+        case 'v':
+          op.type = OpType::MESSAGE;
+          break;
+        case 'f':
+          op.type = OpType::FIELDS;
+          break;
+        case 't':
+          op.type = OpType::THREAD;
+          break;
+        case 'i':
+          op.type = OpType::SEQUENCE;
+          break;
+        case 'n':
+          op.type = OpType::LOGGER_NAME;
+          break;
+        case 's':
+          op.type = OpType::SOURCE_FILE;
+          break;
+        case 'g':
+          op.type = OpType::SOURCE_PATH;
+          break;
+        case '#':
+          op.type = OpType::SOURCE_LINE;
+          break;
+        case '!':
+          op.type = OpType::SOURCE_FUNCTION;
+          break;
+        case '@':
+          op.type = OpType::SOURCE_FILE_LINE;
+          break;
+        default:
+          AddLiteral(text + i, next - i);
+          i = next;
+          continue;
+      }
+
+      ops.push_back(op);
+      i = next;
+    }
+  }
+
+  std::size_t Layout::KnownLength(const Op &i_op, const LoggerEvent &i_event)
+  {
+    switch (i_op.type)
+    {
+      case OpType::LITERAL:
+        return i_op.size;
+      case OpType::LEVEL:
+        return GetLevelName(i_event.level).size();
+      case OpType::MESSAGE:
+        return i_event.data.size();
+      default:
+        return std::string::npos;
+    }
+  }
+
+  void Layout::Render(std::string &o_buffer, const LoggerEvent &i_event) const
+  {
+    for (const Op & op : ops)
+    {
+      // Для правого выравнивания поля известной длины отступ добавляется сразу, без сдвига текста
+      std::size_t known = op.width != 0 && op.left_align == false ? KnownLength(op, i_event) : std::string::npos;
+      if (known != std::string::npos && known < op.width)
+      {
+        o_buffer.append(op.width - known, ' ');
+      }
+
+      std::size_t start = o_buffer.size();
+
+      switch (op.type)
+      {
+        case OpType::LITERAL:
+          o_buffer.append(texts, op.offset, op.size);
+          break;
+        case OpType::TIMESTAMP:
+        {
+          char timestamp[128];
+          std::int64_t time_ns = i_event.time_ns != 0 ? i_event.time_ns : static_cast<std::int64_t>(i_event.time) * 1000000000;
+          std::size_t timestamp_len = Logger::FormatTimestampNs(timestamp, sizeof(timestamp), texts.data() + op.offset, time_ns);
+          o_buffer.append(timestamp, timestamp_len);
+          break;
+        }
+        case OpType::LEVEL:
+          o_buffer += GetLevelName(i_event.level);
+          break;
+        case OpType::MESSAGE:
+          o_buffer.append(i_event.data.data(), i_event.data.size());
+          break;
+        case OpType::FIELDS:
+          if (i_event.fields.empty() == false)
+          {
+            RenderFieldsText(o_buffer, i_event.fields.data(), i_event.fields.size());
+          }
+          break;
+        case OpType::THREAD:
+          AppendNumber(o_buffer, i_event.thread_id);
+          break;
+        case OpType::SEQUENCE:
+          AppendNumber(o_buffer, i_event.sequence);
+          break;
+        case OpType::LOGGER_NAME:
+          if (i_event.logger_name != nullptr)
+          {
+            o_buffer += i_event.logger_name;
+          }
+          break;
+        case OpType::SOURCE_FILE:
+          if (i_event.location != nullptr)
+          {
+            o_buffer += BaseName(i_event.location->file);
+          }
+          break;
+        case OpType::SOURCE_PATH:
+          if (i_event.location != nullptr)
+          {
+            o_buffer += i_event.location->file;
+          }
+          break;
+        case OpType::SOURCE_LINE:
+          if (i_event.location != nullptr)
+          {
+            AppendNumber(o_buffer, i_event.location->line);
+          }
+          break;
+        case OpType::SOURCE_FUNCTION:
+          if (i_event.location != nullptr)
+          {
+            o_buffer += i_event.location->function;
+          }
+          break;
+        case OpType::SOURCE_FILE_LINE:
+          if (i_event.location != nullptr)
+          {
+            o_buffer += BaseName(i_event.location->file);
+            o_buffer += ':';
+            AppendNumber(o_buffer, i_event.location->line);
+          }
+          break;
+      }
+
+      std::size_t written = o_buffer.size() - start;
+      if (written < op.width)
+      {
+        if (op.left_align == true)
+        {
+          o_buffer.append(op.width - written, ' ');
+        }
+        else if (known == std::string::npos)
+        {
+          o_buffer.insert(start, op.width - written, ' ');
+        }
+      }
+    }
+
+    o_buffer += '\n';
+  }
+
+  std::shared_ptr<const Layout> HandlerInterface::GetLayout()
+  {
+    std::unique_lock<std::mutex> lock(events_mtx);
+    return layout;
+  }
+
+  void HandlerInterface::SetLayout(std::shared_ptr<const Layout> i_layout)
+  {
+    std::unique_lock<std::mutex> lock(events_mtx);
+    layout = std::move(i_layout);
+  }
+
+  void HandlerInterface::AppendLine(std::string &o_buffer, const LoggerEvent &i_event, bool i_left_align) const
+  {
+    if (layout != nullptr)
+    {
+      layout->Append(o_buffer, i_event);
+    }
+    else
+    {
+      AppendDefaultLine(o_buffer, i_event, i_left_align);
+    }
+  }
+}
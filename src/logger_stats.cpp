@@ -0,0 +1,107 @@
+#include "logger_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace slx
+{
+  LatencyHistogram::LatencyHistogram()
+    : count(0), sum(0), max(0)
+  {
+    for (auto & bucket : buckets)
+    {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void LatencyHistogram::Record(std::uint64_t i_value, std::uint64_t i_times)
+  {
+    if (i_times == 0)
+    {
+      return;
+    }
+
+    buckets[BucketIndex(i_value)].fetch_add(i_times, std::memory_order_relaxed);
+    count.fetch_add(i_times, std::memory_order_relaxed);
+    sum.fetch_add(i_value * i_times, std::memory_order_relaxed);
+
+    std::uint64_t current = max.load(std::memory_order_relaxed);
+    while (current < i_value && max.compare_exchange_weak(current, i_value, std::memory_order_relaxed) == false)
+    {
+    }
+  }
+
+  LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const
+  {
+    Snapshot snapshot;
+    snapshot.buckets.resize(BUCKET_COUNT);
+
+    // count считается по интервалам, чтобы Percentile не выходил за пределы снимка
+    for (std::size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+      snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+      snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.sum = sum.load(std::memory_order_relaxed);
+    snapshot.max = max.load(std::memory_order_relaxed);
+
+    return snapshot;
+  }
+
+  std::uint64_t LatencyHistogram::BucketLowerBound(std::size_t i_index)
+  {
+    if (i_index < SUB_BUCKETS)
+    {
+      return i_index;
+    }
+
+    std::size_t shift = i_index / SUB_BUCKETS - 1;
+    std::uint64_t sub_bucket = i_index % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub_bucket) << shift;
+  }
+
+  std::uint64_t LatencyHistogram::BucketUpperBound(std::size_t i_index)
+  {
+    if (i_index < SUB_BUCKETS)
+    {
+      return i_index;
+    }
+
+    std::size_t shift = i_index / SUB_BUCKETS - 1;
+    return BucketLowerBound(i_index) + ((std::uint64_t(1) << shift) - 1);
+  }
+
+  std::uint64_t LatencyHistogram::Snapshot::Percentile(double i_quantile) const
+  {
+    if (count == 0)
+    {
+      return 0;
+    }
+
+    double clamped = std::min(std::max(i_quantile, 0.0), 1.0);
+    std::uint64_t rank = static_cast<std::uint64_t>(std::ceil(clamped * static_cast<double>(count)));
+    rank = std::max<std::uint64_t>(rank, 1);
+
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i)
+    {
+      seen += buckets[i];
+      if (seen >= rank)
+      {
+        return std::min(BucketUpperBound(i), max);
+      }
+    }
+
+    return max;
+  }
+
+  double LatencyHistogram::Snapshot::Mean() const
+  {
+    if (count == 0)
+    {
+      return 0;
+    }
+
+    return static_cast<double>(sum) / static_cast<double>(count);
+  }
+}
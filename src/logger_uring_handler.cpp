@@ -0,0 +1,430 @@
+#include "logger_uring_handler.hpp"
+#include "logger_default_handlers.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define LOGGER_HAVE_IO_URING 1
+#endif
+
+namespace slx
+{
+  namespace
+  {
+    //! Количество записей в кольце: запись и fsync
+    const unsigned RING_ENTRIES = 4;
+
+    template<typename T>
+    T * RingField(void *i_ring, unsigned i_offset)
+    {
+      return reinterpret_cast<T *>(static_cast<char *>(i_ring) + i_offset);
+    }
+
+    unsigned LoadAcquire(const unsigned *i_ptr)
+    {
+      return __atomic_load_n(i_ptr, __ATOMIC_ACQUIRE);
+    }
+
+    void StoreRelease(unsigned *o_ptr, unsigned i_value)
+    {
+      __atomic_store_n(o_ptr, i_value, __ATOMIC_RELEASE);
+    }
+  }
+
+  HandlerUringFile::HandlerUringFile(const std::string & i_filename)
+    : fd(-1), offset(0), current(0), inflight_offset(0), inflight_index(0), inflight(0), write_inflight(false)
+    , ring_fd(-1), sq_ring(nullptr), sq_ring_size(0), cq_ring(nullptr), cq_ring_size(0), sqes(nullptr), sqes_size(0)
+    , sq_head(nullptr), sq_tail(nullptr), sq_mask(nullptr), sq_array(nullptr)
+    , cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr), cqes(nullptr)
+  {
+    FlushPolicy policy;
+    policy.every_n = 0;
+    policy.interval = std::chrono::milliseconds(1000);
+    policy.level = LoggerEvent::Level::ERROR;
+    SetFlushPolicy(policy);
+
+    fd = open(i_filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+      return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+    {
+      offset = static_cast<std::uint64_t>(st.st_size);
+    }
+
+    SetupRing();
+  }
+
+  HandlerUringFile::~HandlerUringFile()
+  {
+    if (fd < 0)
+    {
+      return;
+    }
+
+    WaitInflight();
+    fdatasync(fd);
+    DestroyRing();
+    close(fd);
+  }
+
+  bool HandlerUringFile::IsOpen() const
+  {
+    return fd >= 0;
+  }
+
+  bool HandlerUringFile::IsUringActive() const
+  {
+    return ring_fd >= 0;
+  }
+
+  int HandlerUringFile::HandlerFunction(const LoggerEvent &i_event)
+  {
+    const LoggerEvent * event = &i_event;
+    return HandlerFunctionBatch(&event, 1);
+  }
+
+  int HandlerUringFile::HandlerFunctionBatch(const LoggerEvent *const *i_events, std::size_t i_count)
+  {
+    if (fd < 0)
+    {
+      return 1;
+    }
+
+    // Форматирование выполняется, пока ядро записывает предыдущий буфер
+    std::string & buffer = buffers[current];
+    buffer.clear();
+    for (std::size_t i = 0; i < i_count; ++i)
+    {
+      AppendLine(buffer, *i_events[i]);
+    }
+
+    bool success = WaitInflight();
+    bool sync = FlushRequired(i_events, i_count);
+
+    if (ring_fd >= 0)
+    {
+      success = Submit(current, sync) && success;
+      current ^= 1;
+    }
+    else
+    {
+      success = WriteSync(buffer.data(), buffer.size()) && success;
+      if (sync == true)
+      {
+        fdatasync(fd);
+      }
+    }
+
+    return success ? 0 : 1;
+  }
+
+  void HandlerUringFile::FlushFunction()
+  {
+    if (fd < 0)
+    {
+      return;
+    }
+
+    WaitInflight();
+    fdatasync(fd);
+  }
+
+  bool HandlerUringFile::SetupRing()
+  {
+#ifdef LOGGER_HAVE_IO_URING
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    int ring = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+    if (ring < 0)
+    {
+      return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+    {
+      sq_ring_size = std::max(sq_ring_size, cq_ring_size);
+      cq_ring_size = sq_ring_size;
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED)
+    {
+      sq_ring = nullptr;
+      close(ring);
+      return false;
+    }
+
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+    {
+      cq_ring = sq_ring;
+    }
+    else
+    {
+      cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+      if (cq_ring == MAP_FAILED)
+      {
+        cq_ring = nullptr;
+        ring_fd = ring;
+        DestroyRing();
+        return false;
+      }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+      sqes = nullptr;
+      ring_fd = ring;
+      DestroyRing();
+      return false;
+    }
+
+    sq_head = RingField<unsigned>(sq_ring, params.sq_off.head);
+    sq_tail = RingField<unsigned>(sq_ring, params.sq_off.tail);
+    sq_mask = RingField<unsigned>(sq_ring, params.sq_off.ring_mask);
+    sq_array = RingField<unsigned>(sq_ring, params.sq_off.array);
+    cq_head = RingField<unsigned>(cq_ring, params.cq_off.head);
+    cq_tail = RingField<unsigned>(cq_ring, params.cq_off.tail);
+    cq_mask = RingField<unsigned>(cq_ring, params.cq_off.ring_mask);
+    cqes = RingField<void>(cq_ring, params.cq_off.cqes);
+
+    ring_fd = ring;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void HandlerUringFile::DestroyRing()
+  {
+    if (sqes != nullptr)
+    {
+      munmap(sqes, sqes_size);
+      sqes = nullptr;
+    }
+    if (cq_ring != nullptr && cq_ring != sq_ring)
+    {
+      munmap(cq_ring, cq_ring_size);
+    }
+    cq_ring = nullptr;
+    if (sq_ring != nullptr)
+    {
+      munmap(sq_ring, sq_ring_size);
+      sq_ring = nullptr;
+    }
+    if (ring_fd >= 0)
+    {
+      close(ring_fd);
+      ring_fd = -1;
+    }
+  }
+
+  bool HandlerUringFile::Submit(std::size_t i_index, bool i_sync)
+  {
+#ifdef LOGGER_HAVE_IO_URING
+    std::string & buffer = buffers[i_index];
+    if (buffer.empty() == true && i_sync == false)
+    {
+      return true;
+    }
+
+    io_uring_sqe * sqe_array = static_cast<io_uring_sqe *>(sqes);
+    unsigned tail = *sq_tail;
+    unsigned to_submit = 0;
+
+    if (buffer.empty() == false)
+    {
+      iovecs[i_index].iov_base = &buffer[0];
+      iovecs[i_index].iov_len = buffer.size();
+
+      unsigned index = tail & *sq_mask;
+      io_uring_sqe & sqe = sqe_array[index];
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_WRITEV;
+      sqe.fd = fd;
+      sqe.off = offset;
+      sqe.addr = reinterpret_cast<std::uint64_t>(&iovecs[i_index]);
+      sqe.len = 1;
+      sqe.user_data = 1;
+      if (i_sync == true)
+      {
+        // fsync выполняется только после завершения записи
+        sqe.flags = IOSQE_IO_LINK;
+      }
+      sq_array[index] = index;
+      ++tail;
+      ++to_submit;
+
+      inflight_offset = offset;
+      inflight_index = i_index;
+      offset += buffer.size();
+    }
+    bool write_queued = (buffer.empty() == false);
+
+    if (i_sync == true)
+    {
+      unsigned index = tail & *sq_mask;
+      io_uring_sqe & sqe = sqe_array[index];
+      std::memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_FSYNC;
+      sqe.fd = fd;
+      sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+      sqe.user_data = 2;
+      sq_array[index] = index;
+      ++tail;
+      ++to_submit;
+    }
+
+    StoreRelease(sq_tail, tail);
+
+    // Ядро может принять только часть запросов, остальные отправляются повторно
+    unsigned submitted = 0;
+    while (submitted < to_submit)
+    {
+      int res = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit - submitted, 0, 0, nullptr, 0));
+      if (res < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (res <= 0)
+      {
+        break;
+      }
+      submitted += static_cast<unsigned>(res);
+    }
+
+    inflight += submitted;
+    write_inflight = write_queued && submitted != 0;
+    if (submitted == to_submit)
+    {
+      return true;
+    }
+
+    // Кольцо неработоспособно: непринятые запросы убираются из очереди, принятые дожидаются завершения,
+    // остаток выполняется синхронно. Запросы принимаются по порядку, запись отправляется первой
+    StoreRelease(sq_tail, tail - (to_submit - submitted));
+    bool success = WaitInflight();
+    DestroyRing();
+    if (write_queued == true && submitted == 0)
+    {
+      offset = inflight_offset;
+      success = WriteSync(buffer.data(), buffer.size()) && success;
+    }
+    if (i_sync == true)
+    {
+      success = fdatasync(fd) == 0 && success;
+    }
+    return success;
+#else
+    (void)i_index;
+    (void)i_sync;
+    return false;
+#endif
+  }
+
+  bool HandlerUringFile::WaitInflight()
+  {
+#ifdef LOGGER_HAVE_IO_URING
+    bool success = true;
+
+    while (inflight > 0)
+    {
+      unsigned head = *cq_head;
+      if (head == LoadAcquire(cq_tail))
+      {
+        int res = static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (res < 0 && errno != EINTR)
+        {
+          // Завершение операций неизвестно: кольцо освобождается, чтобы буфер не использовался ядром
+          // при следующей отправке, и буфер переписывается синхронно по тому же смещению
+          inflight = 0;
+          DestroyRing();
+          if (write_inflight == true)
+          {
+            write_inflight = false;
+            const std::string & buffer = buffers[inflight_index];
+            std::uint64_t saved_offset = offset;
+            offset = inflight_offset;
+            WriteSync(buffer.data(), buffer.size());
+            offset = saved_offset;
+          }
+          return false;
+        }
+        continue;
+      }
+
+      const io_uring_cqe & cqe = static_cast<const io_uring_cqe *>(cqes)[head & *cq_mask];
+      if (cqe.user_data == 1)
+      {
+        write_inflight = false;
+        const std::string & buffer = buffers[inflight_index];
+        std::size_t written = cqe.res < 0 ? 0 : static_cast<std::size_t>(cqe.res);
+        if (written < buffer.size())
+        {
+          // Ошибка или короткая запись, остаток дописывается синхронно по смещению отправленной записи.
+          // offset уже сдвинут Submit на весь буфер
+          std::uint64_t saved_offset = offset;
+          offset = inflight_offset + written;
+          success = WriteSync(buffer.data() + written, buffer.size() - written) && success;
+          offset = saved_offset;
+        }
+      }
+      else if (cqe.res == -ECANCELED)
+      {
+        // fsync, связанный с короткой записью, отменяется ядром. Остаток записи уже дописан синхронно
+        success = fdatasync(fd) == 0 && success;
+      }
+      else if (cqe.res < 0)
+      {
+        success = false;
+      }
+
+      StoreRelease(cq_head, head + 1);
+      --inflight;
+    }
+
+    return success;
+#else
+    return true;
+#endif
+  }
+
+  bool HandlerUringFile::WriteSync(const char *i_data, std::size_t i_size)
+  {
+    while (i_size > 0)
+    {
+      ssize_t res = pwrite(fd, i_data, i_size, static_cast<off_t>(offset));
+      if (res < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        return false;
+      }
+
+      offset += static_cast<std::uint64_t>(res);
+      i_data += res;
+      i_size -= static_cast<std::size_t>(res);
+    }
+
+    return true;
+  }
+}
@@ -0,0 +1,344 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "logger.hpp"
+#include "logger_default_handlers.hpp"
+
+using namespace slx;
+
+namespace
+{
+  //! Обработчик, запоминающий порядковые номера событий
+  class HandlerSequence : public HandlerInterface
+  {
+  public:
+    //! Номера событий в порядке получения. Читаются после остановки потоков логгера
+    std::vector<std::uint64_t> sequences;
+
+  protected:
+    int HandlerFunction(const LoggerEvent &i_event) override
+    {
+      sequences.push_back(i_event.sequence);
+      return 0;
+    }
+  };
+
+  //! Проверить, что номера строго возрастают и получены все события
+  void ExpectOrdered(const HandlerSequence &i_handler, std::size_t i_count)
+  {
+    ASSERT_EQ(i_handler.sequences.size(), i_count);
+    for (std::size_t i = 1; i < i_handler.sequences.size(); ++i)
+    {
+      ASSERT_LT(i_handler.sequences[i - 1], i_handler.sequences[i]) << "position " << i;
+    }
+  }
+
+  //! Медленный обработчик, считающий события уровня ERROR
+  class HandlerSlow : public HandlerInterface
+  {
+  public:
+    //! Количество полученных событий уровня ERROR. Читается после остановки потоков логгера
+    std::size_t errors = 0;
+
+  protected:
+    int HandlerFunction(const LoggerEvent &i_event) override
+    {
+      if (i_event.level == LoggerEvent::Level::ERROR)
+      {
+        ++errors;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(20));
+      return 0;
+    }
+  };
+
+  //! Обработчик, удаляющий себя из логгера при первом событии
+  class HandlerSelfRemoving : public HandlerInterface
+  {
+  public:
+    Logger * logger = nullptr;
+    tHandler self;
+
+  protected:
+    int HandlerFunction(const LoggerEvent &) override
+    {
+      if (self != nullptr)
+      {
+        tHandler removed = std::move(self);
+        logger->DelHandler(removed);
+        logger->AddHandler(std::make_shared<HandlerSequence>());
+      }
+      return 0;
+    }
+  };
+
+  //! Обработчик, ожидающий разрешения внутри обработки события
+  class HandlerGate : public HandlerInterface
+  {
+  public:
+    std::atomic<bool> entered{false};
+    std::atomic<bool> released{false};
+
+  protected:
+    int HandlerFunction(const LoggerEvent &) override
+    {
+      entered = true;
+      while (released == false)
+      {
+        std::this_thread::yield();
+      }
+      return 0;
+    }
+  };
+
+  const int PRODUCERS = 4;
+  const int EVENTS_PER_PRODUCER = 20000;
+}
+
+//! Несколько производителей в режиме ASYNC с несколькими потоками обработки
+TEST(LoggerShards, MultiProducerOrder)
+{
+  std::shared_ptr<HandlerSequence> handler = std::make_shared<HandlerSequence>();
+  handler->SetLogLevel(LoggerEvent::Level::INFO);
+
+  Logger logger(Logger::Mode::ASYNC);
+  logger.SetOverflowPolicy(Logger::OverflowPolicy::BLOCK);
+  logger.SetWorkerCount(PRODUCERS);
+  logger.AddHandler(handler);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; ++p)
+  {
+    producers.emplace_back([&logger, p]()
+                           {
+                             for (int i = 0; i < EVENTS_PER_PRODUCER; ++i)
+                             {
+                               logger.Log(LoggerEvent::Level::INFO, "producer %d event %d", p, i);
+                             }
+                           });
+  }
+  for (auto & producer : producers)
+  {
+    producer.join();
+  }
+
+  logger.SetMode(Logger::Mode::SYNC);
+
+  ExpectOrdered(*handler, static_cast<std::size_t>(PRODUCERS) * EVENTS_PER_PRODUCER);
+}
+
+//! Смена количества потоков обработки и режима во время записи событий
+TEST(LoggerShards, ReconfigureUnderLoad)
+{
+  std::shared_ptr<HandlerSequence> handler = std::make_shared<HandlerSequence>();
+  handler->SetLogLevel(LoggerEvent::Level::INFO);
+
+  Logger logger(Logger::Mode::ASYNC);
+  logger.SetOverflowPolicy(Logger::OverflowPolicy::BLOCK);
+  logger.SetWorkerCount(2);
+  logger.AddHandler(handler);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; ++p)
+  {
+    producers.emplace_back([&logger]()
+                           {
+                             for (int i = 0; i < EVENTS_PER_PRODUCER; ++i)
+                             {
+                               logger.Log(LoggerEvent::Level::INFO, "event %d", i);
+                             }
+                           });
+  }
+
+  for (int step = 0; step < 20; ++step)
+  {
+    logger.SetWorkerCount(static_cast<std::size_t>(step % 3 + 2));
+    if (step % 5 == 0)
+    {
+      logger.SetMode(Logger::Mode::ASYNC_BUFFERED);
+      logger.SetMode(Logger::Mode::ASYNC);
+    }
+    std::this_thread::yield();
+  }
+
+  for (auto & producer : producers)
+  {
+    producer.join();
+  }
+
+  logger.SetMode(Logger::Mode::SYNC);
+
+  ASSERT_EQ(handler->sequences.size(), static_cast<std::size_t>(PRODUCERS) * EVENTS_PER_PRODUCER);
+}
+
+//! В режиме ASYNC_BUFFERED политика DROP_BELOW_LEVEL отбрасывает только события ниже drop_level
+TEST(LoggerBuffered, DropBelowLevelKeepsErrors)
+{
+  std::shared_ptr<HandlerSlow> handler = std::make_shared<HandlerSlow>();
+  handler->SetLogLevel(LoggerEvent::Level::INFO);
+
+  Logger logger(Logger::Mode::ASYNC_BUFFERED, 64);
+  logger.SetStagingCapacity(16);
+  logger.SetOverflowPolicy(Logger::OverflowPolicy::DROP_BELOW_LEVEL);
+  logger.SetDropLevel(LoggerEvent::Level::ERROR);
+  logger.AddHandler(handler);
+
+  const int EVENTS = 4000;
+  for (int i = 0; i < EVENTS; ++i)
+  {
+    logger.Log(i % 10 == 0 ? LoggerEvent::Level::ERROR : LoggerEvent::Level::INFO, "event %d", i);
+  }
+
+  logger.SetMode(Logger::Mode::SYNC);
+
+  Logger::DropCounters drops = logger.GetDropCounters();
+  EXPECT_EQ(handler->errors, static_cast<std::size_t>(EVENTS / 10));
+  EXPECT_GT(drops.below_level + drops.oldest, 0u);
+  EXPECT_EQ(drops.newest, 0u);
+  EXPECT_EQ(drops.timeout, 0u);
+}
+
+//! В режиме ASYNC_BUFFERED политика BLOCK дожидается обработки пачек без потерь
+TEST(LoggerBuffered, BlockDeliversAll)
+{
+  std::shared_ptr<HandlerSlow> handler = std::make_shared<HandlerSlow>();
+  handler->SetLogLevel(LoggerEvent::Level::INFO);
+
+  Logger logger(Logger::Mode::ASYNC_BUFFERED, 64);
+  logger.SetStagingCapacity(16);
+  logger.SetOverflowPolicy(Logger::OverflowPolicy::BLOCK);
+  logger.AddHandler(handler);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < PRODUCERS; ++p)
+  {
+    producers.emplace_back([&logger]()
+                           {
+                             for (int i = 0; i < 500; ++i)
+                             {
+                               logger.Log(LoggerEvent::Level::ERROR, "event %d", i);
+                             }
+                           });
+  }
+  for (auto & producer : producers)
+  {
+    producer.join();
+  }
+
+  logger.SetMode(Logger::Mode::SYNC);
+
+  Logger::DropCounters drops = logger.GetDropCounters();
+  EXPECT_EQ(handler->errors, static_cast<std::size_t>(PRODUCERS) * 500);
+  EXPECT_EQ(drops.newest + drops.oldest + drops.below_level + drops.timeout, 0u);
+}
+
+//! Ротация по размеру выполняется и внутри одной пачки после предыдущей ротации
+TEST(HandlerRotatingFile, RotatesWithinBatch)
+{
+  std::string filename = "test_rotating_" + std::to_string(getpid()) + ".log";
+
+  HandlerRotatingFile::RotationPolicy policy;
+  policy.max_size = 1000;
+  policy.generations = 20;
+  policy.compression = HandlerRotatingFile::Compression::NONE;
+
+  std::vector<LoggerEvent> events(100);
+  for (auto & event : events)
+  {
+    event.level = LoggerEvent::Level::INFO;
+    event.data = std::string(40, 'x');
+  }
+
+  {
+    HandlerRotatingFile handler(filename, policy);
+    handler.SetLogLevel(LoggerEvent::Level::INFO);
+    handler.HandleEvents(events.data(), events.size());
+  }
+
+  std::vector<std::string> files = {filename};
+  for (std::size_t i = 1; i <= policy.generations; ++i)
+  {
+    files.push_back(filename + "." + std::to_string(i));
+  }
+
+  std::size_t generations = 0;
+  for (const auto & name : files)
+  {
+    struct stat st;
+    if (stat(name.c_str(), &st) == 0)
+    {
+      EXPECT_LE(static_cast<std::size_t>(st.st_size), policy.max_size) << name;
+      ++generations;
+      std::remove(name.c_str());
+    }
+  }
+  EXPECT_GT(generations, 2u);
+}
+
+//! Обработчик может удалить себя и добавить другой обработчик во время обработки события
+TEST(LoggerHandlers, ChangeFromDispatch)
+{
+  std::shared_ptr<HandlerSelfRemoving> handler = std::make_shared<HandlerSelfRemoving>();
+  handler->SetLogLevel(LoggerEvent::Level::INFO);
+
+  Logger logger(Logger::Mode::SYNC);
+  handler->logger = &logger;
+  handler->self = handler;
+  logger.AddHandler(handler);
+
+  logger.Log(LoggerEvent::Level::INFO, "first");
+  logger.Log(LoggerEvent::Level::INFO, "second");
+
+  ASSERT_EQ(logger.GetHandlersCount(), 1u);
+  EXPECT_NE(logger.GetHandlerByIndex(0), handler);
+}
+
+//! Добавление обработчика не ожидает завершения медленной обработки события
+TEST(LoggerHandlers, AddDoesNotWaitForDispatch)
+{
+  std::shared_ptr<HandlerGate> gate = std::make_shared<HandlerGate>();
+  gate->SetLogLevel(LoggerEvent::Level::INFO);
+
+  Logger logger(Logger::Mode::SYNC);
+  logger.AddHandler(gate);
+
+  std::thread producer([&logger]()
+                       {
+                         logger.Log(LoggerEvent::Level::INFO, "slow");
+                       });
+  while (gate->entered == false)
+  {
+    std::this_thread::yield();
+  }
+
+  EXPECT_EQ(logger.AddHandler(std::make_shared<HandlerSequence>()), Logger::RET_SUCCESS);
+  EXPECT_EQ(logger.GetHandlersCount(), 2u);
+
+  gate->released = true;
+  producer.join();
+}
+
+//! Поле хранит копию строки, поэтому его можно использовать после удаления исходной строки
+TEST(LogField, StoresStringByValue)
+{
+  auto field = Field("name", std::string(64, 'n'));
+  std::string encoded;
+  EncodeFields(encoded, field);
+
+  const char * pos = encoded.data();
+  FieldValue value;
+  ASSERT_TRUE(ReadField(pos, encoded.data() + encoded.size(), value));
+  EXPECT_EQ(value.key, "name");
+  EXPECT_EQ(value.string, std::string(64, 'n'));
+}
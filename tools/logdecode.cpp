@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "logger_binary_handler.hpp"
+#include "logger_default_handlers.hpp"
+#include "logger_layout.hpp"
+
+//! Утилита преобразования двоичных файлов журнала в текст
+/*!
+  Использование: logdecode [-p PATTERN] FILE...
+  События выводятся в stdout в формате HandlerFilename или по шаблону slx::Layout, например
+  logdecode -p "%d{%H:%M:%S.%6N} %-5l %@ %v%f" app.blog
+*/
+int main(int argc, char *argv[])
+{
+  int first = 1;
+  std::unique_ptr<slx::Layout> layout;
+  if (argc > 2 && std::strcmp(argv[1], "-p") == 0)
+  {
+    layout.reset(new slx::Layout(argv[2]));
+    first = 3;
+  }
+
+  if (argc <= first)
+  {
+    fprintf(stderr, "usage: %s [-p PATTERN] FILE...\n", argv[0]);
+    return 2;
+  }
+
+  int result = 0;
+  std::string buffer;
+  slx::LoggerEvent event;
+
+  for (int i = first; i < argc; ++i)
+  {
+    slx::BinaryLogReader reader(argv[i]);
+    if (reader.IsOpen() == false)
+    {
+      fprintf(stderr, "%s: not a binary log file\n", argv[i]);
+      result = 1;
+      continue;
+    }
+
+    while (reader.ReadEvent(event) == true)
+    {
+      buffer.clear();
+      if (layout != nullptr)
+      {
+        layout->Append(buffer, event);
+      }
+      else
+      {
+        slx::AppendDefaultLine(buffer, event);
+      }
+      fwrite(buffer.data(), 1, buffer.size(), stdout);
+    }
+
+    if (reader.IsCorrupted() == true)
+    {
+      fprintf(stderr, "%s: file is truncated or corrupted\n", argv[i]);
+      result = 1;
+    }
+  }
+
+  return result;
+}